@@ -2,11 +2,51 @@
 #include <fstream>
 #include <vector>
 #include <queue>
+#include <string>
+#include <map>
 #include <utility>
 #include <algorithm>
+#include <random>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <chrono>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <filesystem>
+#include <sstream>
+#include <csignal>
+#include <cerrno>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "wall_runs.h"
+#include "dungeon_file.h"
+#include "bitboard.h"
+#include "solution_cache.h"
 
 using namespace std;
 
+// Monsters the compact state holds; dungeons with more get the wide state. Change it with -DMAX_MONSTERS=<n>
+#ifndef MAX_MONSTERS
+#define MAX_MONSTERS 16
+#endif
+
+// Monsters the wide state holds, as many as its one-byte count can number
+const int kWideMonsters = 255;
+
+// Search counters cost a few additions per node; build with -DNO_SEARCH_STATS to compile them out
+#ifndef NO_SEARCH_STATS
+#define SEARCH_STAT(...) __VA_ARGS__
+#else
+#define SEARCH_STAT(...)
+#endif
+
 // Define the directions for Act-Man and monsters
 enum Direction
 {
@@ -16,335 +56,3947 @@ enum Direction
     West
 };
 
-// Structure to represent the game state
-struct State
+// How monsters answer Act-Man's action in the search
+enum MonsterModel
+{
+    AnyMonsterMove, // One monster takes any of its moves: every choice is a separate successor
+    GreedyMonsters  // Every monster follows the simulator's greedy policy: one successor per action
+};
+
+// Structure to hold the parts of the dungeon that never change during a search
+struct Dungeon
+{
+    int numRows;
+    int numCols;
+    vector<char> grid;            // Row-major static layout: walls and floor markings, no Act-Man or monsters
+    WallRuns wallRuns;            // Bullet reach from every cell in each Direction
+    SmallBoard board;             // Floor as a bitboard; board.words is 0 when the dungeon is too big for one
+    vector<uint64_t> kingSteps;   // Per cell, board.words words: the floor cells a monster may step to from it
+    vector<uint64_t> actManKeys;  // Zobrist key per cell for Act-Man
+    vector<uint64_t> monsterKeys; // Zobrist key per packed monster (cell and type bit)
+    uint64_t bulletKey;           // Toggled when the bullet is fired
+    uint64_t caughtKey;           // Toggled when a monster catches Act-Man
+    MonsterModel monsterModel = AnyMonsterMove;
+    uint64_t greedyId = 0; // Greedy model: tells dungeons apart in the per-thread distance caches
+};
+
+// Structure to represent the game state, with room for Capacity monsters
+// Cells are row-major indices into the Dungeon; monsters are kept sorted as (cell << 1 | isOgre).
+// The search code takes the state type as a template parameter, so each dungeon is solved with the
+// smallest state that fits its monsters; see withStateFor.
+template <int Capacity>
+struct PackedState
+{
+    static const int kCapacity = Capacity;
+
+    uint64_t hashKey;                 // Zobrist key of the fields below
+    uint32_t actManCell;              // Act-Man's cell (the cell he was caught on once caught is set)
+    int16_t score;                    // Player's score
+    bool bulletFired;                 // Flag to check if Act-Man has fired a bullet
+    bool caught;                      // Flag set when a monster reaches Act-Man
+    uint8_t monsterCount;             // Number of entries used in monsters
+    uint32_t monsters[Capacity];      // Packed monsters, sorted so equal sets compare equal
+};
+
+// Compact state for the common case; wide state for dungeons with more than MAX_MONSTERS monsters
+typedef PackedState<MAX_MONSTERS> CompactState;
+typedef PackedState<kWideMonsters> WideState;
+
+// One-byte codes for Act-Man's actions, stored in the node pool instead of action strings
+enum ActionCode : uint8_t
+{
+    MoveNorth = North, // Move codes share their values with Direction
+    MoveSouth = South,
+    MoveEast = East,
+    MoveWest = West,
+    FireNorth,         // Fire codes are FireNorth + Direction
+    FireSouth,
+    FireEast,
+    FireWest,
+    NoAction,            // Firing again after the bullet is spent: Act-Man waits
+    EliminateFlag = 0x80 // Set on an action that also eliminated a monster
+};
+
+// Parent index of the root node
+const uint32_t kNoParent = UINT32_MAX;
+
+// Structure to store a state in the search node pool
+template <class State>
+struct SearchNode
+{
+    State state;
+    uint32_t parent; // Index of the node this one was expanded from
+    uint8_t action;  // ActionCode of Act-Man's action taken from the parent
+};
+
+// Structure to hold what an in-place move changed, so unmakeMove can restore the state exactly
+// Scalars are saved whole; monster edits are described rather than copied, except after the greedy
+// model, which can move every monster at once.
+template <class State>
+struct UndoRecord
+{
+    uint64_t hashKey;
+    uint32_t actManCell;
+    int16_t score;
+    bool bulletFired;
+    bool caught;
+    uint8_t eliminatedDemons; // Monsters removed from eliminatedCell, by type
+    uint8_t eliminatedOgres;
+    uint32_t eliminatedCell;
+    uint32_t movedFrom;      // Packed monster before a single monster move
+    uint32_t movedTo;        // Packed monster after it; equal to movedFrom if no monster moved
+    bool savedMonsters;      // Set when monsters holds the whole list from before the move
+    uint32_t monsters[State::kCapacity];
+};
+
+// Structure to hold the result of a search
+template <class State>
+struct Solution
+{
+    State finalState;
+    vector<string> actions{}; // Actions taken to reach finalState
+    int64_t bulletMark = -1; // Cell where the bullet eliminated a monster, drawn as '@'
+    vector<uint8_t> plyActions{}; // ActionCode of every ply, NoAction included, for the solution cache
+    vector<uint64_t> plyKeys{};   // Key of the state each ply was taken from
+    bool partial = false;       // The search ran out of budget; this is its best plan so far
+};
+
+// Phase times are taken on one expansion in kPhaseSampleRate, which keeps clock reads off the hot path
+const uint64_t kPhaseSampleRate = 16;
+
+// Counters kept while expanding nodes; parallel searches keep one per chunk and add them up
+struct ExpansionCounters
+{
+    uint64_t expansions = 0;      // Nodes passed to the successor generators
+    uint64_t timedExpansions = 0; // Expansions whose phases were timed
+    uint64_t successors = 0;      // States produced by Act-Man's action and the monster move
+    uint64_t actManNanos = 0;     // Time spent making Act-Man's actions on timed expansions
+    uint64_t monsterNanos = 0;    // Time spent on the monster moves and visiting the successors on timed expansions
+};
+
+// Structure to hold one BFS layer's share of a search
+struct LayerStats
+{
+    uint64_t nodes; // Nodes of the layer taken off the frontier
+    uint64_t nanos; // Time spent expanding them
+};
+
+// Structure to hold the instrumentation of one search, written out by --stats
+struct SearchStats
 {
-    vector<vector<char>> dungeonLayout;
-    pair<int, int> actManPos;
-    vector<pair<int, int>> monsterPositions;
-    int score;
-    vector<string> actions; // Actions taken to reach this state
-    bool bulletFired;       // Flag to check if Act-Man has fired a bullet
+    string algorithm;
+    uint64_t nodesExpanded = 0;
+    uint64_t duplicatesPruned = 0; // Successors dropped because their configuration was already reached
+    uint64_t nodesStored = 0;      // Nodes held by the search when it ended
+    uint64_t peakFrontier = 0;     // Largest number of nodes waiting to be expanded
+    uint64_t memoryBytes = 0;      // Node storage and visited set when the search ended
+    uint64_t spilledBytes = 0;     // Bytes written to spill files (external-memory BFS only)
+    uint64_t totalNanos = 0;
+    ExpansionCounters expansion;
+    vector<LayerStats> layers; // Breadth-first searches, and one per depth for minimax and expectimax
 };
 
-// Function to check if Act-Man can move to a given position
-bool canMove(const State &state, int row, int col)
+// Function to read the monotonic clock in nanoseconds
+uint64_t nowNanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Expansions between clock reads while a search runs under a time limit
+const uint64_t kBudgetCheckRate = 64;
+
+// Limits on a search; a search that reaches one stops and returns its best plan so far
+struct SearchBudget
 {
-    if (row < 0 || row >= state.dungeonLayout.size() ||
-        col < 0 || col >= state.dungeonLayout[0].size())
+    uint64_t nodeLimit = 0;      // Expansions allowed, 0 for no limit
+    uint64_t timeLimitNanos = 0; // Time allowed from start(), 0 for no limit
+    uint64_t deadline = 0;       // nowNanos() when the time runs out, 0 for none
+
+    // Function to check whether either limit is set
+    bool limited() const
     {
-        return false; // Out of bounds
+        return nodeLimit || timeLimitNanos;
+    }
+
+    // Function to start the clock for one search
+    void start()
+    {
+        deadline = timeLimitNanos ? nowNanos() + timeLimitNanos : 0;
+    }
+
+    // Function to check whether a search that has expanded a number of nodes must stop
+    bool exhausted(uint64_t expanded) const
+    {
+        if (nodeLimit && expanded >= nodeLimit)
+        {
+            return true;
+        }
+        return deadline && expanded % kBudgetCheckRate == 0 && nowNanos() >= deadline;
     }
-    return state.dungeonLayout[row][col] != '#'; // Not a wall
+};
+
+// Function to close a BFS layer in the stats and start timing the next one
+void recordLayer(SearchStats &stats, uint64_t nodes, uint64_t &layerStart)
+{
+    uint64_t now = nowNanos();
+    stats.layers.push_back({nodes, now - layerStart});
+    layerStart = now;
 }
 
-// Function to check if Act-Man wins
-bool isWin(const State &state)
+// Set on batch workers, which solve many dungeons at once and skip the per-search report lines
+thread_local bool quietSearch = false;
+
+// Function to get the stream a search prints its summary line to
+ostream &searchReport()
 {
-    return state.monsterPositions.empty(); // All monsters eliminated
+    static thread_local ostream discard(nullptr); // No buffer: every write is dropped
+    return quietSearch ? discard : cerr;
 }
 
-// Function to check if Act-Man loses
-bool isLoss(const State &state)
+// Largest node pool or table a thread keeps for its next search
+const size_t kReusableBytes = 8 << 20;
+
+// Function to empty a per-thread buffer for the next search, releasing it if a big search left it oversized
+template <class T>
+void recycle(vector<T> &buffer)
+{
+    buffer.clear();
+    if (buffer.capacity() * sizeof(T) > kReusableBytes)
+    {
+        buffer.shrink_to_fit();
+    }
+}
+
+// Function to pack a monster into its sorted representation
+uint32_t packMonster(uint32_t cell, char type)
+{
+    return (cell << 1) | (type == 'G' ? 1 : 0);
+}
+
+// Function to get the cell of a packed monster
+uint32_t monsterCell(uint32_t monster)
+{
+    return monster >> 1;
+}
+
+// Function to get the layout character of a packed monster
+char monsterType(uint32_t monster)
 {
-    return state.actManPos == make_pair(-1, -1) || state.score <= 0; // Act-Man caught or score drops to zero
+    return (monster & 1) ? 'G' : 'D';
 }
 
-// Function to apply Act-Man's action (move or fire bullet)
-State applyActManAction(const State &currentState, Direction direction)
+// Function to fill the dungeon's Zobrist tables
+void initZobrist(Dungeon &dungeon)
 {
-    State nextState = currentState;
-    int dx = 0, dy = 0;
-    string action;
-    switch (direction)
+    mt19937_64 rng(0x9E3779B97F4A7C15ULL); // Fixed seed keeps keys reproducible between runs
+    size_t numCells = static_cast<size_t>(dungeon.numRows) * dungeon.numCols;
+    dungeon.actManKeys.resize(numCells);
+    dungeon.monsterKeys.resize(numCells * 2);
+    for (auto &key : dungeon.actManKeys)
     {
-    case North:
-        dx = -1;
-        action = "Move North";
-        break;
-    case South:
-        dx = 1;
-        action = "Move South";
-        break;
-    case East:
-        dy = 1;
-        action = "Move East";
-        break;
-    case West:
-        dy = -1;
-        action = "Move West";
-        break;
+        key = rng();
     }
-    int newRow = currentState.actManPos.first + dx;
-    int newCol = currentState.actManPos.second + dy;
-    if (canMove(currentState, newRow, newCol))
+    for (auto &key : dungeon.monsterKeys)
     {
-        if (nextState.dungeonLayout[newRow][newCol] == 'D' || nextState.dungeonLayout[newRow][newCol] == 'G')
-        {
-            // Monster encountered, eliminate it
-            nextState.dungeonLayout[newRow][newCol] = '@';
-            nextState.monsterPositions.erase(
-                remove(nextState.monsterPositions.begin(), nextState.monsterPositions.end(), make_pair(newRow, newCol)),
-                nextState.monsterPositions.end());
-            nextState.score += 5; // Increase score for eliminating monster
-            action += " and Eliminate Monster";
-        }
-        nextState.score--;                                                                          // Decrease score for moving
-        nextState.dungeonLayout[currentState.actManPos.first][currentState.actManPos.second] = ' '; // Clear Act-Man's previous position
-        nextState.actManPos = make_pair(newRow, newCol);
-        nextState.dungeonLayout[newRow][newCol] = 'A'; // Update Act-Man's position
+        key = rng();
+    }
+    dungeon.bulletKey = rng();
+    dungeon.caughtKey = rng();
+}
+
+// Function to mix the score into the key (scores are unbounded, so they are hashed rather than tabulated)
+uint64_t scoreKey(int score)
+{
+    uint64_t x = static_cast<uint64_t>(static_cast<int64_t>(score)) + 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Function to compute a state's key from scratch (used once for the initial state)
+template <class State>
+uint64_t computeHashKey(const Dungeon &dungeon, const State &state)
+{
+    uint64_t key = scoreKey(state.score) ^ dungeon.actManKeys[state.actManCell];
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        key ^= dungeon.monsterKeys[state.monsters[i]];
+    }
+    if (state.bulletFired)
+    {
+        key ^= dungeon.bulletKey;
+    }
+    if (state.caught)
+    {
+        key ^= dungeon.caughtKey;
+    }
+    return key;
+}
+
+// Function to change the score while keeping the key in sync
+template <class State>
+void addScore(State &state, int delta)
+{
+    state.hashKey ^= scoreKey(state.score) ^ scoreKey(state.score + delta);
+    state.score += delta;
+}
+
+// Function to move Act-Man to a cell while keeping the key in sync
+template <class State>
+void setActManCell(const Dungeon &dungeon, State &state, uint32_t cell)
+{
+    state.hashKey ^= dungeon.actManKeys[state.actManCell] ^ dungeon.actManKeys[cell];
+    state.actManCell = cell;
+}
+
+// Function to remove the monster at an index of the sorted list while keeping the key in sync
+template <class State>
+void removeMonster(const Dungeon &dungeon, State &state, int index)
+{
+    state.hashKey ^= dungeon.monsterKeys[state.monsters[index]];
+    copy(state.monsters + index + 1, state.monsters + state.monsterCount, state.monsters + index);
+    state.monsterCount--;
+}
+
+// Function to insert a monster into the sorted list while keeping the key in sync
+template <class State>
+void insertMonster(const Dungeon &dungeon, State &state, uint32_t monster)
+{
+    uint32_t *end = state.monsters + state.monsterCount;
+    uint32_t *pos = upper_bound(state.monsters, end, monster);
+    copy_backward(pos, end, end + 1);
+    *pos = monster;
+    state.monsterCount++;
+    state.hashKey ^= dungeon.monsterKeys[monster];
+}
+
+// Function to remove every monster standing on a cell; returns true if there was one
+template <class State>
+bool removeMonstersAt(const Dungeon &dungeon, State &state, uint32_t cell)
+{
+    uint32_t *end = state.monsters + state.monsterCount;
+    int first = lower_bound(state.monsters, end, packMonster(cell, 'D')) - state.monsters;
+    bool removed = false;
+    while (first < state.monsterCount && monsterCell(state.monsters[first]) == cell)
+    {
+        removeMonster(dungeon, state, first);
+        removed = true;
     }
-    nextState.actions.push_back(action);
-    return nextState;
+    return removed;
 }
 
-// Function to fire the magic bullet
-State fireMagicBullet(const State &currentState)
+// Function to check if a cell holds a monster
+template <class State>
+bool hasMonsterAt(const State &state, uint32_t cell)
 {
-    State nextState = currentState;
-    if (!nextState.bulletFired)
+    const uint32_t *end = state.monsters + state.monsterCount;
+    const uint32_t *it = lower_bound(state.monsters, end, packMonster(cell, 'D'));
+    return it != end && monsterCell(*it) == cell;
+}
+
+// Open-addressing set of visited state keys with hit/miss counters
+class TranspositionTable
+{
+public:
+    TranspositionTable() : slots(1 << 16, 0), used(0), lookups(0), hits(0) {}
+
+    // Function to record a key; returns false if it was already present
+    bool insert(uint64_t key)
     {
-        nextState.bulletFired = true; // Set bullet fired flag to true
-        int row = nextState.actManPos.first;
-        int col = nextState.actManPos.second;
-        switch (currentState.dungeonLayout[row][col])
+        ++lookups;
+        if (key == 0)
         {
-        case North:
-            for (int r = row - 1; r >= 0; --r)
+            key = 1; // 0 marks an empty slot
+        }
+        if ((used + 1) * 2 > slots.size())
+        {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t i = key & mask;; i = (i + 1) & mask)
+        {
+            if (slots[i] == key)
             {
-                if (currentState.dungeonLayout[r][col] == '#')
-                {
-                    break; // Hit a wall, stop bullet
-                }
-                else if (currentState.dungeonLayout[r][col] == 'D' || currentState.dungeonLayout[r][col] == 'G')
-                {
-                    // Monster encountered, eliminate it
-                    nextState.dungeonLayout[r][col] = '@';
-                    nextState.monsterPositions.erase(
-                        remove(nextState.monsterPositions.begin(), nextState.monsterPositions.end(), make_pair(r, col)),
-                        nextState.monsterPositions.end());
-                    nextState.score += 5; // Increase score for eliminating monster
-                    break;                // Bullet stops after hitting a monster
-                }
+                ++hits;
+                return false;
             }
-            break;
-        case South:
-            for (int r = row + 1; r < nextState.dungeonLayout.size(); ++r)
+            if (slots[i] == 0)
             {
-                if (currentState.dungeonLayout[r][col] == '#')
-                {
-                    break; // Hit a wall, stop bullet
-                }
-                else if (currentState.dungeonLayout[r][col] == 'D' || currentState.dungeonLayout[r][col] == 'G')
-                {
-                    // Monster encountered, eliminate it
-                    nextState.dungeonLayout[r][col] = '@';
-                    nextState.monsterPositions.erase(
-                        remove(nextState.monsterPositions.begin(), nextState.monsterPositions.end(), make_pair(r, col)),
-                        nextState.monsterPositions.end());
-                    nextState.score += 5; // Increase score for eliminating monster
-                    break;                // Bullet stops after hitting a monster
-                }
+                slots[i] = key;
+                ++used;
+                return true;
             }
-            break;
-        case East:
-            for (int c = col + 1; c < nextState.dungeonLayout[0].size(); ++c)
+        }
+    }
+
+    // Function to get the bytes held by the table
+    size_t memoryBytes() const
+    {
+        return slots.size() * sizeof(uint64_t);
+    }
+
+    // Function to empty the table for the next search, keeping its slots unless they grew past kReusableBytes
+    void clear()
+    {
+        if (memoryBytes() > kReusableBytes)
+        {
+            vector<uint64_t>(1 << 16, 0).swap(slots);
+        }
+        else
+        {
+            fill(slots.begin(), slots.end(), 0);
+        }
+        used = lookups = hits = 0;
+    }
+
+    // Function to print how much of the frontier the table removed
+    void reportHitRate(ostream &out) const
+    {
+        double rate = lookups ? 100.0 * hits / lookups : 0.0;
+        out << "Transposition table: " << lookups << " lookups, " << hits << " duplicates dropped ("
+            << rate << "% hit rate), " << used << " unique states" << endl;
+    }
+
+private:
+    vector<uint64_t> slots;
+    size_t used;
+    size_t lookups;
+    size_t hits;
+
+    // Function to double the table and re-insert every key
+    void grow()
+    {
+        vector<uint64_t> old(slots.size() * 2, 0);
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (uint64_t key : old)
+        {
+            if (key == 0)
+                continue;
+            size_t i = key & mask;
+            while (slots[i] != 0)
             {
-                if (currentState.dungeonLayout[row][c] == '#')
-                {
-                    break; // Hit a wall, stop bullet
-                }
-                else if (currentState.dungeonLayout[row][c] == 'D' || currentState.dungeonLayout[row][c] == 'G')
-                {
-                    // Monster encountered, eliminate it
-                    nextState.dungeonLayout[row][c] = '@';
-                    nextState.monsterPositions.erase(
-                        remove(nextState.monsterPositions.begin(), nextState.monsterPositions.end(), make_pair(row, c)),
-                        nextState.monsterPositions.end());
-                    nextState.score += 5; // Increase score for eliminating monster
-                    break;                // Bullet stops after hitting a monster
-                }
+                i = (i + 1) & mask;
             }
-            break;
-        case West:
-            for (int c = col - 1; c >= 0; --c)
+            slots[i] = key;
+        }
+    }
+};
+
+// Open-addressing map from state keys to the fewest plies they were reached in, used by A*
+// Entries sit inline in one slot array, so recording a configuration allocates nothing until the table doubles.
+class DepthTable
+{
+public:
+    static const uint32_t kUnseen = UINT32_MAX;
+
+    DepthTable() : slots(1 << 16), used(0) {}
+
+    // Function to start loading the slot a lookup of key begins at
+    void prefetch(uint64_t key) const
+    {
+        key = key ? key : 1;
+        __builtin_prefetch(&slots[key & (slots.size() - 1)]);
+    }
+
+    // Function to get the depth recorded for a key, or kUnseen
+    uint32_t depth(uint64_t key) const
+    {
+        key = key ? key : 1; // 0 marks an empty slot
+        size_t mask = slots.size() - 1;
+        for (size_t i = key & mask; slots[i].key != 0; i = (i + 1) & mask)
+        {
+            if (slots[i].key == key)
             {
-                if (currentState.dungeonLayout[row][c] == '#')
-                {
-                    break; // Hit a wall, stop bullet
-                }
-                else if (currentState.dungeonLayout[row][c] == 'D' || currentState.dungeonLayout[row][c] == 'G')
-                {
-                    // Monster encountered, eliminate it
-                    nextState.dungeonLayout[row][c] = '@';
-                    nextState.monsterPositions.erase(
-                        remove(nextState.monsterPositions.begin(), nextState.monsterPositions.end(), make_pair(row, c)),
-                        nextState.monsterPositions.end());
-                    nextState.score += 5; // Increase score for eliminating monster
-                    break;                // Bullet stops after hitting a monster
-                }
+                return slots[i].depth;
             }
-            break;
         }
-        nextState.score--;                          // Decrease score for firing the bullet
-        nextState.actions.push_back("Fire Bullet"); // Record the action
+        return kUnseen;
     }
-    return nextState;
-}
 
-// Function to generate all possible successor states after Act-Man's action
-vector<State> generateActManSuccessors(const State &currentState)
+    // Function to record the depth of a key, replacing any earlier one
+    void set(uint64_t key, uint32_t depth)
+    {
+        key = key ? key : 1;
+        if ((used + 1) * 2 > slots.size())
+        {
+            grow();
+        }
+        size_t mask = slots.size() - 1;
+        size_t i = key & mask;
+        while (slots[i].key != 0 && slots[i].key != key)
+        {
+            i = (i + 1) & mask;
+        }
+        used += slots[i].key == 0;
+        slots[i] = {key, depth};
+    }
+
+    // Function to get the bytes held by the table
+    size_t memoryBytes() const
+    {
+        return slots.size() * sizeof(Slot);
+    }
+
+    // Function to empty the table for the next search, keeping its slots unless they grew past kReusableBytes
+    void clear()
+    {
+        if (memoryBytes() > kReusableBytes)
+        {
+            vector<Slot>(1 << 16).swap(slots);
+        }
+        else
+        {
+            fill(slots.begin(), slots.end(), Slot());
+        }
+        used = 0;
+    }
+
+private:
+    struct Slot
+    {
+        uint64_t key = 0;
+        uint32_t depth = 0;
+    };
+
+    vector<Slot> slots;
+    size_t used;
+
+    // Function to double the table and re-insert every entry
+    void grow()
+    {
+        vector<Slot> old(slots.size() * 2);
+        old.swap(slots);
+        size_t mask = slots.size() - 1;
+        for (const Slot &slot : old)
+        {
+            if (slot.key == 0)
+                continue;
+            size_t i = slot.key & mask;
+            while (slots[i].key != 0)
+            {
+                i = (i + 1) & mask;
+            }
+            slots[i] = slot;
+        }
+    }
+};
+
+// Function to check if Act-Man or a monster can move to a given position
+bool canMove(const Dungeon &dungeon, int row, int col)
 {
-    vector<State> successors;
-    for (int dir = 0; dir < 4; ++dir)
+    if (row < 0 || row >= dungeon.numRows ||
+        col < 0 || col >= dungeon.numCols)
     {
-        Direction direction = static_cast<Direction>(dir);
-        State nextState = applyActManAction(currentState, direction);
-        successors.push_back(nextState);
+        return false; // Out of bounds
     }
-    // Add a successor with firing the bullet
-    State nextStateWithBullet = fireMagicBullet(currentState);
-    successors.push_back(nextStateWithBullet);
-    return successors;
+    return dungeon.grid[row * dungeon.numCols + col] != '#'; // Not a wall
 }
 
-// Function to generate all possible successor states after monster movement
-vector<State> generateMonsterSuccessors(const State &currentState)
+// Distance value for cells that cannot be reached
+const uint16_t kUnreachable = UINT16_MAX;
+
+// Function to fill field with the king-move distance from a source cell along the floor
+void computeKingDistances(const Dungeon &dungeon, uint32_t source, uint16_t *field, vector<uint32_t> &frontier)
 {
-    vector<State> successors;
-    for (const auto &monsterPos : currentState.monsterPositions)
+    if (kingDistancesOnBoard(dungeon.board, source, field, kUnreachable))
+        return; // Small dungeon: whole frontiers at a time, no saturation needed below kMaxBoardCells
+    fill(field, field + static_cast<size_t>(dungeon.numRows) * dungeon.numCols, kUnreachable);
+    frontier.assign(1, source);
+    field[source] = 0;
+    for (size_t i = 0; i < frontier.size(); ++i)
     {
+        uint32_t cell = frontier[i];
+        int row = cell / dungeon.numCols;
+        int col = cell % dungeon.numCols;
+        uint16_t next = min<int>(field[cell] + 1, kUnreachable - 1); // Saturating keeps the bound admissible
         for (int dr = -1; dr <= 1; ++dr)
         {
             for (int dc = -1; dc <= 1; ++dc)
             {
-                if (dr == 0 && dc == 0)
-                    continue; // Skip current position
-                int newRow = monsterPos.first + dr;
-                int newCol = monsterPos.second + dc;
-                if (canMove(currentState, newRow, newCol))
+                uint32_t neighbor = (row + dr) * dungeon.numCols + col + dc;
+                if ((dr || dc) && canMove(dungeon, row + dr, col + dc) && field[neighbor] == kUnreachable)
                 {
-                    State nextState = currentState;
-                    nextState.dungeonLayout[monsterPos.first][monsterPos.second] = ' '; // Clear monster's previous position
-                    nextState.monsterPositions.erase(
-                        remove(nextState.monsterPositions.begin(), nextState.monsterPositions.end(), monsterPos),
-                        nextState.monsterPositions.end());
-                    nextState.monsterPositions.push_back(make_pair(newRow, newCol)); // Update monster's position
-                    if (nextState.dungeonLayout[newRow][newCol] == 'A')
-                    {
-                        // Act-Man encountered, game over
-                        nextState.dungeonLayout[newRow][newCol] = 'X';
-                        nextState.actManPos = make_pair(-1, -1); // Update Act-Man's position to outside dungeon
-                    }
-                    else
-                    {
-                        nextState.dungeonLayout[newRow][newCol] = (currentState.dungeonLayout[monsterPos.first][monsterPos.second] == 'D') ? 'D' : 'G';
-                    }
-                    successors.push_back(nextState);
+                    field[neighbor] = next;
+                    frontier.push_back(neighbor);
                 }
             }
         }
     }
-    return successors;
 }
 
-// Function to perform breadth-first search to find a solution
-State bfs(const State &initialState)
+// Memory each thread may spend caching distance fields for the greedy monster model
+const size_t kGreedyFieldBudget = 64 << 20;
+
+// Function to prepare the dungeon for the greedy monster model
+void initGreedyMonsters(Dungeon &dungeon)
 {
-    queue<State> q;
-    q.push(initialState);
-    while (!q.empty())
+    static atomic<uint64_t> nextId(1);
+    dungeon.monsterModel = GreedyMonsters;
+    dungeon.greedyId = nextId++;
+}
+
+// Function to get the distance field from Act-Man's cell used by the greedy monster model
+// Fields are flood-filled on first use and cached per thread; the cache starts over when it would
+// outgrow kGreedyFieldBudget or the thread moves on to another dungeon.
+const uint16_t *greedyDistanceField(const Dungeon &dungeon, uint32_t actManCell)
+{
+    static thread_local uint64_t cachedDungeon = 0;
+    static thread_local vector<vector<uint16_t>> fields;
+    static thread_local size_t cachedBytes = 0;
+    static thread_local vector<uint32_t> frontier;
+    size_t numCells = static_cast<size_t>(dungeon.numRows) * dungeon.numCols;
+    if (cachedDungeon != dungeon.greedyId || cachedBytes + numCells * sizeof(uint16_t) > kGreedyFieldBudget)
     {
-        State currentState = q.front();
-        q.pop();
-        if (isWin(currentState) || isLoss(currentState))
-        {
-            return currentState;
-        }
-        vector<State> actManSuccessors = generateActManSuccessors(currentState);
-        for (const auto &successor : actManSuccessors)
-        {
-            vector<State> monsterSuccessors = generateMonsterSuccessors(successor);
-            for (const auto &monsterSuccessor : monsterSuccessors)
-            {
-                q.push(monsterSuccessor);
-            }
-        }
+        fields.assign(numCells, vector<uint16_t>());
+        cachedBytes = 0;
+        cachedDungeon = dungeon.greedyId;
+    }
+    vector<uint16_t> &field = fields[actManCell];
+    if (field.empty())
+    {
+        field.resize(numCells);
+        computeKingDistances(dungeon, actManCell, field.data(), frontier);
+        cachedBytes += numCells * sizeof(uint16_t);
     }
-    return initialState; // No solution found
+    return field.data();
 }
 
-// Function to read input from file
-State readInputFromFile(const string &filename)
+// Function to check if Act-Man wins
+template <class State>
+bool isWin(const State &state)
+{
+    return state.monsterCount == 0; // All monsters eliminated
+}
+
+// Function to check if Act-Man loses
+template <class State>
+bool isLoss(const State &state)
+{
+    return state.caught || state.score <= 0; // Act-Man caught or score drops to zero
+}
+
+// Function to start an undo record for a move about to be made on a state
+template <class State>
+void beginUndo(const State &state, UndoRecord<State> &undo)
+{
+    undo.hashKey = state.hashKey;
+    undo.actManCell = state.actManCell;
+    undo.score = state.score;
+    undo.bulletFired = state.bulletFired;
+    undo.caught = state.caught;
+    undo.eliminatedDemons = 0;
+    undo.eliminatedOgres = 0;
+    undo.movedFrom = undo.movedTo = 0;
+    undo.savedMonsters = false;
+}
+
+// Function to eliminate every monster on a cell in place, noting them in the undo record
+template <class State>
+bool eliminateMonstersAt(const Dungeon &dungeon, State &state, uint32_t cell, UndoRecord<State> &undo)
 {
-    ifstream inputFile(filename);
-    if (!inputFile.is_open())
+    const uint32_t *begin = state.monsters;
+    const uint32_t *end = begin + state.monsterCount;
+    const uint32_t *first = lower_bound(begin, end, packMonster(cell, 'D'));
+    for (const uint32_t *it = first; it != end && monsterCell(*it) == cell; ++it)
     {
-        cerr << "Error: Failed to open input file." << endl;
-        exit(EXIT_FAILURE);
+        (monsterType(*it) == 'G' ? undo.eliminatedOgres : undo.eliminatedDemons)++;
     }
-    State initialState;
-    string line;
-    int numRows, numCols;
-    inputFile >> numRows >> numCols;
-    getline(inputFile, line); // Consume newline character
-    initialState.dungeonLayout.resize(numRows, vector<char>(numCols));
-    for (int i = 0; i < numRows; ++i)
+    undo.eliminatedCell = cell;
+    return removeMonstersAt(dungeon, state, cell);
+}
+
+// Move generation cell by cell with bounds checks, for dungeons too big for a bitboard
+struct GridMoves
+{
+    const Dungeon &dungeon;
+
+    // Cells the greedy model's monsters hold while they move one after another
+    struct Taken
+    {
+        const uint32_t *cells;
+        int count;
+    };
+
+    explicit GridMoves(const Dungeon &dungeon) : dungeon(dungeon)
+    {
+    }
+
+    // Function to find the cell one step from cell in a direction; returns false if it is a wall or off the dungeon
+    bool step(uint32_t cell, Direction direction, uint32_t &next) const
     {
-        getline(inputFile, line);
-        for (int j = 0; j < numCols; ++j)
+        int row = cell / dungeon.numCols + kRayRowStep[direction];
+        int col = cell % dungeon.numCols + kRayColStep[direction];
+        if (!canMove(dungeon, row, col))
+            return false;
+        next = row * dungeon.numCols + col;
+        return true;
+    }
+
+    // Function to call visit(next) for every floor cell a king step from cell, in increasing order
+    template <class Visit>
+    void forEachNeighbour(uint32_t cell, Visit visit) const
+    {
+        int row = cell / dungeon.numCols;
+        int col = cell % dungeon.numCols;
+        for (int dr = -1; dr <= 1; ++dr)
         {
-            initialState.dungeonLayout[i][j] = line[j];
-            if (line[j] == 'A')
-            {
-                initialState.actManPos = make_pair(i, j);
-            }
-            else if (line[j] == 'D' || line[j] == 'G')
+            for (int dc = -1; dc <= 1; ++dc)
             {
-                initialState.monsterPositions.push_back(make_pair(i, j));
+                if ((dr || dc) && canMove(dungeon, row + dr, col + dc))
+                    visit(static_cast<uint32_t>((row + dr) * dungeon.numCols + col + dc));
             }
         }
     }
-    inputFile.close();
-    initialState.score = 50;
-    initialState.bulletFired = false; // Initialize bullet fired flag
-    return initialState;
-}
 
-// Function to write output to file
-void writeOutputToFile(const string &filename, const State &finalState)
-{
-    ofstream outputFile(filename);
-    if (!outputFile.is_open())
+    // Function to get the taken set of the given monster cells; it reads them in place, so it follows their moves
+    Taken taken(const uint32_t *cells, int count) const
+    {
+        return {cells, count};
+    }
+
+    // Function to note a monster's move in the taken set; the set reads the cells in place, so there is nothing to do
+    void move(Taken &, uint32_t, uint32_t) const
     {
-        cerr << "Error: Failed to open output file." << endl;
-        exit(EXIT_FAILURE);
     }
-    for (const auto &action : finalState.actions)
+
+    // Function to call visit(next) for every floor cell a king step from cell that is not taken, in increasing order
+    template <class Visit>
+    void forEachFreeNeighbour(uint32_t cell, const Taken &taken, Visit visit) const
     {
-        outputFile << action << endl;
+        forEachNeighbour(cell, [&](uint32_t next)
+                         {
+                             if (find(taken.cells, taken.cells + taken.count, next) == taken.cells + taken.count)
+                                 visit(next); });
     }
-    outputFile << "Score: " << finalState.score << endl;
-    for (const auto &row : finalState.dungeonLayout)
+
+    // Function to find the cell where a bullet fired from Act-Man stops on a monster (-1 if it reaches a wall)
+    // The wall-run table gives the ray's reach in one lookup; the nearest monster within reach is hit
+    template <class State>
+    int64_t bulletHitCell(const State &state, Direction direction) const
     {
-        for (char cell : row)
+        int row = state.actManCell / dungeon.numCols;
+        int col = state.actManCell % dungeon.numCols;
+        int reach = dungeon.wallRuns.run(row, col, direction);
+        int nearest = reach + 1;
+        int64_t hit = -1;
+        for (int i = 0; i < state.monsterCount; ++i)
         {
-            outputFile << cell;
+            uint32_t cell = monsterCell(state.monsters[i]);
+            int dr = static_cast<int>(cell / dungeon.numCols) - row;
+            int dc = static_cast<int>(cell % dungeon.numCols) - col;
+            // Steps along the ray, or 0 if the monster is not on it
+            int steps = kRayRowStep[direction] ? (dc == 0 ? dr * kRayRowStep[direction] : 0)
+                                               : (dr == 0 ? dc * kRayColStep[direction] : 0);
+            if (steps > 0 && steps < nearest)
+            {
+                nearest = steps;
+                hit = cell;
+            }
         }
-        outputFile << endl;
+        return hit;
     }
-    outputFile.close();
-}
+};
+
+// Move generation by shift-and-mask on the dungeon's board of Words words
+// Same answers, in the same order, as GridMoves: neighbours come out of the board in increasing cell order,
+// which is the order of the grid's row and column steps.
+template <int Words>
+struct BoardMoves
+{
+    typedef Bitboard<Words> Board;
+    typedef Board Taken;
+
+    const Dungeon &dungeon;
+    BoardMasks<Words> masks;
+
+    explicit BoardMoves(const Dungeon &dungeon) : dungeon(dungeon), masks(dungeon.board)
+    {
+    }
+
+    bool step(uint32_t cell, Direction direction, uint32_t &next) const
+    {
+        Board target = masks.step(Board::single(cell), direction) & masks.floor;
+        if (!target.any())
+            return false;
+        next = target.lowest();
+        return true;
+    }
+
+    // Function to get the floor cells a king step from cell, from the table built with the board
+    Board neighbours(uint32_t cell) const
+    {
+        return Board::load(&dungeon.kingSteps[static_cast<size_t>(cell) * Words]);
+    }
+
+    template <class Visit>
+    void forEachNeighbour(uint32_t cell, Visit visit) const
+    {
+        neighbours(cell).forEach([&](int next)
+                                 { visit(static_cast<uint32_t>(next)); });
+    }
+
+    Taken taken(const uint32_t *cells, int count) const
+    {
+        Board board = {};
+        for (int i = 0; i < count; ++i)
+        {
+            board.set(cells[i]);
+        }
+        return board;
+    }
+
+    // Function to move a monster in the taken set; the greedy model never lets two monsters share a cell
+    void move(Taken &taken, uint32_t from, uint32_t to) const
+    {
+        taken.reset(from);
+        taken.set(to);
+    }
+
+    template <class Visit>
+    void forEachFreeNeighbour(uint32_t cell, const Taken &taken, Visit visit) const
+    {
+        (neighbours(cell) & ~taken).forEach([&](int next)
+                                            { visit(static_cast<uint32_t>(next)); });
+    }
+
+    // Function to find the cell where a bullet fired from Act-Man stops on a monster (-1 if it reaches a wall)
+    // The monsters on the bullet's path are one mask; the nearest is the highest cell going north or west
+    template <class State>
+    int64_t bulletHitCell(const State &state, Direction direction) const
+    {
+        int reach = dungeon.wallRuns.run(state.actManCell / dungeon.numCols, state.actManCell % dungeon.numCols,
+                                         direction);
+        Board monsters = {};
+        for (int i = 0; i < state.monsterCount; ++i)
+        {
+            monsters.set(monsterCell(state.monsters[i]));
+        }
+        Board hits = masks.ray(state.actManCell, direction, reach) & monsters;
+        return direction == North || direction == West ? hits.highest() : hits.lowest();
+    }
+};
+
+// Function to call f(moves) with the move generator chosen for the dungeon when it was loaded
+// Dungeons of up to kMaxBoardCells cells get the bitboard one for their number of words, bigger ones the grid
+template <class F>
+auto withMoves(const Dungeon &dungeon, F f)
+{
+    switch (dungeon.board.words)
+    {
+    case 1:
+        return f(BoardMoves<1>(dungeon));
+    case 2:
+        return f(BoardMoves<2>(dungeon));
+    case 3:
+        return f(BoardMoves<3>(dungeon));
+    case 4:
+        return f(BoardMoves<4>(dungeon));
+    default:
+        return f(GridMoves(dungeon));
+    }
+}
+
+// Function to make Act-Man's move in place
+template <class State, class Moves>
+void makeActManMove(const Moves &moves, State &state, Direction direction, uint8_t &action, UndoRecord<State> &undo)
+{
+    beginUndo(state, undo);
+    action = direction;
+    uint32_t newCell;
+    if (moves.step(state.actManCell, direction, newCell))
+    {
+        if (eliminateMonstersAt(moves.dungeon, state, newCell, undo))
+        {
+            // Monster encountered, eliminate it
+            addScore(state, 5); // Increase score for eliminating monster
+            action |= EliminateFlag;
+        }
+        addScore(state, -1);                         // Decrease score for moving
+        setActManCell(moves.dungeon, state, newCell); // Update Act-Man's position
+    }
+}
+
+// Function to fire the magic bullet in place; returns false (leaving the state as it was) if it was already spent
+template <class State, class Moves>
+bool makeFireBullet(const Moves &moves, State &state, Direction direction, uint8_t &action, UndoRecord<State> &undo)
+{
+    beginUndo(state, undo);
+    if (state.bulletFired)
+    {
+        action = NoAction;
+        return false;
+    }
+    action = FireNorth + direction;
+    int64_t hit = moves.bulletHitCell(state, direction);
+    state.bulletFired = true; // Set bullet fired flag to true
+    state.hashKey ^= moves.dungeon.bulletKey;
+    if (hit >= 0)
+    {
+        // Monster encountered, eliminate it (the bullet stops after hitting a monster)
+        eliminateMonstersAt(moves.dungeon, state, hit, undo);
+        addScore(state, 5); // Increase score for eliminating monster
+        action |= EliminateFlag;
+    }
+    addScore(state, -1); // Decrease score for firing the bullet
+    return true;
+}
+
+// Function to move one monster to a neighbouring cell in place; catching Act-Man ends the game
+template <class State>
+void makeMonsterMove(const Dungeon &dungeon, State &state, int index, uint32_t newCell, UndoRecord<State> &undo)
+{
+    beginUndo(state, undo);
+    undo.movedFrom = state.monsters[index];
+    undo.movedTo = packMonster(newCell, monsterType(undo.movedFrom));
+    removeMonster(dungeon, state, index);
+    insertMonster(dungeon, state, undo.movedTo); // Update monster's position
+    if (newCell == state.actManCell)
+    {
+        // Act-Man encountered, game over
+        state.caught = true;
+        state.hashKey ^= dungeon.caughtKey;
+    }
+}
+
+// Function to take back a move made in place
+template <class State>
+void unmakeMove(const Dungeon &dungeon, State &state, const UndoRecord<State> &undo)
+{
+    if (undo.savedMonsters)
+    {
+        copy(undo.monsters, undo.monsters + State::kCapacity, state.monsters);
+    }
+    else if (undo.movedFrom != undo.movedTo)
+    {
+        uint32_t *end = state.monsters + state.monsterCount;
+        removeMonster(dungeon, state, lower_bound(state.monsters, end, undo.movedTo) - state.monsters);
+        insertMonster(dungeon, state, undo.movedFrom);
+    }
+    for (int i = 0; i < undo.eliminatedDemons; ++i)
+    {
+        insertMonster(dungeon, state, packMonster(undo.eliminatedCell, 'D'));
+    }
+    for (int i = 0; i < undo.eliminatedOgres; ++i)
+    {
+        insertMonster(dungeon, state, packMonster(undo.eliminatedCell, 'G'));
+    }
+    // The key is restored whole, so the incremental updates above need not cancel out
+    state.hashKey = undo.hashKey;
+    state.actManCell = undo.actManCell;
+    state.score = undo.score;
+    state.bulletFired = undo.bulletFired;
+    state.caught = undo.caught;
+}
+
+// Function to move every monster one step with the greedy policy of hw1.cpp's moveMonsters
+// Each monster takes the free neighbouring cell closest to Act-Man along the floor, breaking ties by
+// straight-line distance and then scan order, and stays put if every neighbour is a wall or taken.
+// Monsters move one after another in cell order, where the simulator shuffles the order every turn unless it
+// runs with --monster-order=cells; hw1 --replay plays such plans back under these rules.
+template <class State, class Moves>
+void makeGreedyMonsterMoves(const Moves &moves, State &state, UndoRecord<State> &undo)
+{
+    const Dungeon &dungeon = moves.dungeon;
+    beginUndo(state, undo);
+    undo.savedMonsters = true;
+    copy(state.monsters, state.monsters + State::kCapacity, undo.monsters);
+    const uint16_t *field = greedyDistanceField(dungeon, state.actManCell);
+    int actManRow = state.actManCell / dungeon.numCols;
+    int actManCol = state.actManCell % dungeon.numCols;
+    uint32_t cells[State::kCapacity];
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        cells[i] = monsterCell(state.monsters[i]);
+    }
+    typename Moves::Taken taken = moves.taken(cells, state.monsterCount);
+    bool moved = false;
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        int64_t bestCell = -1;
+        pair<int, int> bestDistance(INT32_MAX, INT32_MAX);
+        moves.forEachFreeNeighbour(cells[i], taken, [&](uint32_t newCell)
+                                   {
+                                       int newRow = newCell / dungeon.numCols;
+                                       int rowGap = actManRow - newRow;
+                                       int colGap = actManCol - (static_cast<int>(newCell) - newRow * dungeon.numCols);
+                                       pair<int, int> distance(field[newCell], rowGap * rowGap + colGap * colGap);
+                                       if (distance < bestDistance)
+                                       {
+                                           bestDistance = distance;
+                                           bestCell = newCell;
+                                       } });
+        if (bestCell >= 0)
+        {
+            moves.move(taken, cells[i], bestCell);
+            cells[i] = bestCell;
+            moved = true;
+        }
+    }
+    if (!moved)
+    {
+        return;
+    }
+    // Re-pack the moved monsters, keeping the list sorted and the key in sync
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        state.hashKey ^= dungeon.monsterKeys[state.monsters[i]];
+        state.monsters[i] = packMonster(cells[i], monsterType(state.monsters[i]));
+        state.hashKey ^= dungeon.monsterKeys[state.monsters[i]];
+        if (cells[i] == state.actManCell && !state.caught)
+        {
+            // Act-Man encountered, game over
+            state.caught = true;
+            state.hashKey ^= dungeon.caughtKey;
+        }
+    }
+    sort(state.monsters, state.monsters + state.monsterCount);
+}
+
+// Function to call visit(reply) for every monster reply to the Act-Man action just made on state
+// Each reply is made on one scratch copy on the stack, which costs less than taking the move back
+// from the sorted monster list. Stops and returns false as soon as visit() does.
+template <class State, class Moves, class Visit>
+bool forEachMonsterReply(const Moves &moves, const State &state, Visit visit)
+{
+    State reply;
+    UndoRecord<State> undo;
+    if (moves.dungeon.monsterModel == GreedyMonsters)
+    {
+        reply = state;
+        makeGreedyMonsterMoves(moves, reply, undo);
+        return visit(reply);
+    }
+    bool moved = false;
+    bool more = true;
+    for (int i = 0; i < state.monsterCount && more; ++i)
+    {
+        moves.forEachNeighbour(monsterCell(state.monsters[i]), [&](uint32_t newCell)
+                               {
+                                   if (!more)
+                                       return;
+                                   reply = state;
+                                   makeMonsterMove(moves.dungeon, reply, i, newCell, undo);
+                                   moved = true;
+                                   more = visit(reply); });
+    }
+    if (!more)
+    {
+        return false;
+    }
+    // No monster left or none can move: Act-Man's action stands on its own
+    return moved || visit(state);
+}
+
+// Function to stream every state reachable in one ply (Act-Man's action, then one monster move) to a visitor
+// visit(successor, action) sees the successors one at a time, in a fixed order, on scratch states that
+// only live for the call; it copies the ones it keeps, so goal, duplicate and pruning tests run before
+// anything is copied. Returns false if visit() stopped the stream early. The state is taken by value,
+// so a visitor may append to the pool it came from.
+template <class State, class Moves, class Visit>
+bool forEachSuccessorOn(const Moves &moves, State state, [[maybe_unused]] ExpansionCounters &counters, Visit visit)
+{
+    SEARCH_STAT(bool timed = counters.expansions++ % kPhaseSampleRate == 0; uint64_t start = timed ? nowNanos() : 0;
+                uint64_t actManNanos = 0; uint64_t successors = 0); // Added to counters once at the end
+    UndoRecord<State> undo;
+    bool more = true;
+    for (int code = MoveNorth; code <= FireWest && more; ++code)
+    {
+        SEARCH_STAT(uint64_t actManStart = timed ? nowNanos() : 0);
+        uint8_t action;
+        bool fired = true;
+        if (code < FireNorth)
+        {
+            makeActManMove(moves, state, static_cast<Direction>(code), action, undo);
+        }
+        else
+        {
+            fired = makeFireBullet(moves, state, static_cast<Direction>(code - FireNorth), action, undo);
+        }
+        SEARCH_STAT(if (timed) actManNanos += nowNanos() - actManStart);
+        more = forEachMonsterReply(moves, state, [&](const State &successor)
+                                   {
+                                       SEARCH_STAT(successors++);
+                                       return visit(successor, action); });
+        unmakeMove(moves.dungeon, state, undo);
+        if (!fired)
+        {
+            break; // The bullet is spent, so the first fire code already stood for all four
+        }
+    }
+#ifndef NO_SEARCH_STATS
+    if (timed)
+    {
+        counters.timedExpansions++;
+        counters.actManNanos += actManNanos;
+        counters.monsterNanos += nowNanos() - start - actManNanos;
+    }
+    counters.successors += successors;
+#endif
+    return more;
+}
+
+// Function to stream every successor of a state with the dungeon's move generator; see forEachSuccessorOn
+template <class State, class Visit>
+bool forEachSuccessor(const Dungeon &dungeon, const State &state, ExpansionCounters &counters, Visit visit)
+{
+    return withMoves(dungeon, [&](const auto &moves)
+                     { return forEachSuccessorOn(moves, state, counters, visit); });
+}
+
+// Function to fill a buffer with every state reachable in one ply, for callers that need them all at once
+template <class State>
+void generateSuccessors(const Dungeon &dungeon, const State &currentState, ExpansionCounters &counters,
+                        vector<SearchNode<State>> &successors)
+{
+    successors.clear();
+    forEachSuccessor(dungeon, currentState, counters, [&](const State &successor, uint8_t action)
+                     {
+                         successors.push_back({successor, kNoParent, action});
+                         return true; });
+}
+
+// Function to turn an action code back into the text written to the output file
+// A ply spent firing the spent bullet is written as "Wait", so the plan keeps one line per ply
+string actionName(uint8_t action)
+{
+    static const char *const names[] = {"Move North", "Move South", "Move East", "Move West",
+                                        "Fire Bullet North", "Fire Bullet South", "Fire Bullet East", "Fire Bullet West",
+                                        "Wait"};
+    string name = names[action & ~EliminateFlag];
+    if (action & EliminateFlag)
+    {
+        name += " and Eliminate Monster";
+    }
+    return name;
+}
+
+// Function to add one step of a plan to a solution, given the state the action was taken from
+template <class State>
+void recordStep(const Dungeon &dungeon, Solution<State> &solution, const State &fromState, uint8_t action)
+{
+    solution.plyActions.push_back(action);
+    solution.plyKeys.push_back(fromState.hashKey);
+    solution.actions.push_back(actionName(action));
+    uint8_t code = action & ~EliminateFlag;
+    if (code >= FireNorth && (action & EliminateFlag))
+    {
+        solution.bulletMark = withMoves(dungeon, [&](const auto &moves)
+                                        { return moves.bulletHitCell(fromState, static_cast<Direction>(code - FireNorth)); });
+    }
+}
+
+// Function to put a plan that was recorded last step first into order
+template <class State>
+void finishPlan(Solution<State> &solution)
+{
+    reverse(solution.actions.begin(), solution.actions.end());
+    reverse(solution.plyActions.begin(), solution.plyActions.end());
+    reverse(solution.plyKeys.begin(), solution.plyKeys.end());
+}
+
+// Function to rebuild the plan leading to a node by following parent indices back to the root
+template <class State>
+Solution<State> reconstructSolution(const Dungeon &dungeon, const vector<SearchNode<State>> &pool, uint32_t index)
+{
+    Solution<State> solution{pool[index].state};
+    for (; pool[index].parent != kNoParent; index = pool[index].parent)
+    {
+        recordStep(dungeon, solution, pool[pool[index].parent].state, pool[index].action);
+    }
+    finishPlan(solution);
+    return solution;
+}
+
+// Function to rank states for a search that runs out of budget: not lost, then most monsters
+// eliminated, then highest score; returns true if a outranks b
+template <class State>
+bool outranks(const State &a, const State &b)
+{
+    if (isLoss(a))
+    {
+        return false;
+    }
+    if (a.monsterCount != b.monsterCount)
+    {
+        return a.monsterCount < b.monsterCount;
+    }
+    return a.score > b.score;
+}
+
+// Function to return the best plan of a search that ran out of budget
+template <class State>
+Solution<State> bestSoFar(const Dungeon &dungeon, const vector<SearchNode<State>> &pool, uint32_t best, uint64_t expanded)
+{
+    Solution<State> solution = reconstructSolution(dungeon, pool, best);
+    solution.partial = true;
+    searchReport() << "Search budget exhausted after " << expanded << " expansions; best plan so far leaves "
+                   << int(solution.finalState.monsterCount) << " monsters with score " << solution.finalState.score << endl;
+    return solution;
+}
+
+// Function to perform breadth-first search to find a solution
+// Nodes are appended to the pool in BFS order, so the pool doubles as the queue. Under a budget the
+// best-ranked node enqueued so far is kept, and its plan is returned when the budget runs out.
+template <class State>
+Solution<State> bfs(const Dungeon &dungeon, const State &initialState, SearchStats &stats, const SearchBudget &budget)
+{
+    // Kept per thread so back-to-back searches (batch mode) reuse the memory
+    static thread_local TranspositionTable visited; // Configurations already enqueued, keyed by their Zobrist hash
+    static thread_local vector<SearchNode<State>> pool;
+    visited.clear();
+    recycle(pool);
+    visited.insert(initialState.hashKey);
+    pool.push_back({initialState, kNoParent, NoAction});
+    SEARCH_STAT(size_t layerBegin = 0, layerEnd = 1; uint64_t layerStart = nowNanos());
+    // Function to fill in the totals once the search stops at the given head
+    auto finishStats = [&]([[maybe_unused]] uint32_t head)
+    {
+#ifndef NO_SEARCH_STATS
+        recordLayer(stats, head - layerBegin, layerStart);
+        stats.nodesStored = pool.size();
+        stats.memoryBytes = pool.capacity() * sizeof(SearchNode<State>) + visited.memoryBytes();
+#endif
+    };
+    bool limited = budget.limited();
+    uint32_t best = 0; // Under a budget: the node outranking every other one enqueued so far
+    uint32_t head = 0;
+    // Function to queue a successor of the head unless it is a duplicate; returns false once it ends the game
+    auto enqueue = [&](const State &successor, uint8_t action)
+    {
+        // Drop configurations that are already queued or expanded before copying them
+        if (!visited.insert(successor.hashKey))
+        {
+            SEARCH_STAT(stats.duplicatesPruned++);
+            return true;
+        }
+        pool.push_back({successor, head, action});
+        if (limited && outranks(successor, pool[best].state))
+        {
+            best = pool.size() - 1;
+        }
+        return !isWin(successor) && !isLoss(successor);
+    };
+    for (; head < pool.size(); ++head)
+    {
+#ifndef NO_SEARCH_STATS
+        if (head == layerEnd)
+        {
+            recordLayer(stats, layerEnd - layerBegin, layerStart);
+            layerBegin = layerEnd;
+            layerEnd = pool.size();
+        }
+        stats.peakFrontier = max<uint64_t>(stats.peakFrontier, pool.size() - head);
+#endif
+        if (isWin(pool[head].state) || isLoss(pool[head].state))
+        {
+            finishStats(head);
+            visited.reportHitRate(searchReport());
+            return reconstructSolution(dungeon, pool, head);
+        }
+        if (limited && budget.exhausted(head))
+        {
+            finishStats(head);
+            visited.reportHitRate(searchReport());
+            return bestSoFar(dungeon, pool, best, head);
+        }
+        SEARCH_STAT(stats.nodesExpanded++);
+        if (!forEachSuccessor(dungeon, pool[head].state, stats.expansion, enqueue))
+        {
+            // Every node queued before it was tested as it was generated, so this is the first game end the
+            // queue would reach: return it without expanding the rest of the layer
+            finishStats(head + 1);
+            visited.reportHitRate(searchReport());
+            return reconstructSolution(dungeon, pool, pool.size() - 1);
+        }
+    }
+    finishStats(head);
+    visited.reportHitRate(searchReport());
+    return Solution<State>{initialState}; // No solution found
+}
+
+// Visited-state table split into independently locked shards, used by the parallel BFS
+// Each key maps to the ordinal of the successor that claimed it. Ordinals follow the serial BFS
+// enqueue order, so keeping the smallest claim keeps exactly the successor bfs() would have kept.
+class ShardedVisitedTable
+{
+public:
+    explicit ShardedVisitedTable(int shardBits = 6) : shards(1 << shardBits), shardShift(64 - shardBits) {}
+
+    // Function to claim a key for an ordinal; returns false if a smaller ordinal already holds it
+    bool claim(uint64_t key, uint64_t ordinal)
+    {
+        key = key ? key : 1; // 0 marks an empty slot
+        Shard &shard = shards[key >> shardShift];
+        lock_guard<mutex> guard(shard.lock);
+        shard.lookups++;
+        if ((shard.used + 1) * 2 > shard.keys.size())
+        {
+            shard.grow();
+        }
+        size_t i = shard.find(key);
+        if (shard.keys[i] != key)
+        {
+            shard.keys[i] = key;
+            shard.owners[i] = ordinal;
+            shard.used++;
+            return true;
+        }
+        shard.hits++;
+        if (ordinal < shard.owners[i])
+        {
+            shard.owners[i] = ordinal; // An earlier successor of the same layer takes over the key
+            return true;
+        }
+        return false;
+    }
+
+    // Function to check whether an ordinal still holds its key (only valid once a layer's claims are done)
+    bool holds(uint64_t key, uint64_t ordinal) const
+    {
+        key = key ? key : 1;
+        const Shard &shard = shards[key >> shardShift];
+        return shard.owners[shard.find(key)] == ordinal;
+    }
+
+    // Function to get the bytes held by every shard
+    size_t memoryBytes() const
+    {
+        size_t bytes = 0;
+        for (const auto &shard : shards)
+        {
+            bytes += (shard.keys.size() + shard.owners.size()) * sizeof(uint64_t);
+        }
+        return bytes;
+    }
+
+    // Function to print how much of the frontier the table removed
+    void reportHitRate(ostream &out) const
+    {
+        size_t lookups = 0, hits = 0, used = 0;
+        for (const auto &shard : shards)
+        {
+            lookups += shard.lookups;
+            hits += shard.hits;
+            used += shard.used;
+        }
+        double rate = lookups ? 100.0 * hits / lookups : 0.0;
+        out << "Transposition table: " << lookups << " lookups, " << hits << " duplicates dropped ("
+            << rate << "% hit rate), " << used << " unique states" << endl;
+    }
+
+private:
+    // Open-addressing map from key to claiming ordinal; key 0 marks an empty slot
+    struct Shard
+    {
+        mutex lock;
+        vector<uint64_t> keys = vector<uint64_t>(1 << 10, 0);
+        vector<uint64_t> owners = vector<uint64_t>(1 << 10, 0);
+        size_t used = 0;
+        size_t lookups = 0;
+        size_t hits = 0;
+
+        // Function to find the slot holding a key, or the empty slot where it belongs
+        size_t find(uint64_t key) const
+        {
+            size_t mask = keys.size() - 1;
+            size_t i = key & mask;
+            while (keys[i] != 0 && keys[i] != key)
+            {
+                i = (i + 1) & mask;
+            }
+            return i;
+        }
+
+        // Function to double the shard and re-insert every entry
+        void grow()
+        {
+            vector<uint64_t> oldKeys(keys.size() * 2, 0);
+            vector<uint64_t> oldOwners(owners.size() * 2, 0);
+            oldKeys.swap(keys);
+            oldOwners.swap(owners);
+            for (size_t j = 0; j < oldKeys.size(); ++j)
+            {
+                if (oldKeys[j] != 0)
+                {
+                    size_t i = find(oldKeys[j]);
+                    keys[i] = oldKeys[j];
+                    owners[i] = oldOwners[j];
+                }
+            }
+        }
+    };
+    vector<Shard> shards;
+    int shardShift;
+};
+
+// Fixed set of threads that runs parallel loops one after another
+// The threads start once and wait between loops, so a search that runs several loops per layer does
+// not pay for starting and joining threads on every one of them.
+class WorkerPool
+{
+public:
+    explicit WorkerPool(int numThreads)
+    {
+        for (int t = 0; t < numThreads; ++t)
+        {
+            threads.emplace_back([this]()
+                                 { workLoop(); });
+        }
+    }
+
+    ~WorkerPool()
+    {
+        {
+            lock_guard<mutex> lock(guard);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : threads)
+        {
+            worker.join();
+        }
+    }
+
+    // Function to run work(chunk) for every chunk in [0, numChunks) on the pool; returns once every chunk is done
+    // Chunks are handed out from a shared counter, so a worker that finishes early takes the next one
+    void run(size_t numChunks, const function<void(size_t)> &work)
+    {
+        unique_lock<mutex> lock(guard);
+        job = &work;
+        jobChunks = numChunks;
+        nextChunk = 0;
+        busy = threads.size();
+        generation++;
+        wake.notify_all();
+        done.wait(lock, [&]()
+                  { return busy == 0; });
+        job = nullptr;
+    }
+
+private:
+    // Function run by each thread: take part in every loop until the pool is destroyed
+    void workLoop()
+    {
+        uint64_t seen = 0; // Last loop this thread took part in
+        unique_lock<mutex> lock(guard);
+        while (true)
+        {
+            wake.wait(lock, [&]()
+                      { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+            const function<void(size_t)> &work = *job;
+            size_t numChunks = jobChunks;
+            lock.unlock();
+            for (size_t chunk = nextChunk++; chunk < numChunks; chunk = nextChunk++)
+            {
+                work(chunk);
+            }
+            lock.lock();
+            if (--busy == 0)
+            {
+                done.notify_one();
+            }
+        }
+    }
+
+    vector<thread> threads;
+    mutex guard;
+    condition_variable wake; // Signalled when a loop starts or the pool stops
+    condition_variable done; // Signalled when the last thread finishes a loop
+    const function<void(size_t)> *job = nullptr;
+    size_t jobChunks = 0;
+    atomic<size_t> nextChunk{0};
+    size_t busy = 0;         // Threads still working on the current loop
+    uint64_t generation = 0; // Loops started so far
+    bool stopping = false;
+};
+
+// Function to run work(chunk) for every chunk in [0, numChunks) on numThreads threads, for a single loop
+void parallelFor(int numThreads, size_t numChunks, const function<void(size_t)> &work)
+{
+    WorkerPool pool(numThreads);
+    pool.run(numChunks, work);
+}
+
+// Function to perform a level-synchronous breadth-first search on several threads
+// Returns the same result as bfs(): each layer is checked for terminal states in pool order before
+// it is expanded, and duplicate successors resolve to the one the serial search enqueues first.
+template <class State>
+Solution<State> parallelBfs(const Dungeon &dungeon, const State &initialState, int numThreads,
+                     [[maybe_unused]] SearchStats &stats)
+{
+    const size_t kChunkSize = 256; // Frontier nodes per unit of work
+    const int kSuccessorBits = 24; // Ordinal = parent index << kSuccessorBits | successor index
+    WorkerPool workers(numThreads); // Started once; every layer hands its three loops to the same threads
+    ShardedVisitedTable visited;
+    vector<SearchNode<State>> pool;
+    visited.claim(initialState.hashKey, 0);
+    pool.push_back({initialState, kNoParent, NoAction});
+    size_t layerBegin = 0;
+    // Per-chunk buffers, kept across layers so they stop allocating once they reach their largest layer
+    vector<vector<SearchNode<State>>> chunkSuccessors; // Successor buffers, one per chunk to keep their order
+    vector<vector<uint64_t>> chunkOrdinals;
+    vector<ExpansionCounters> chunkCounters;
+    vector<size_t> offsets;
+    SEARCH_STAT(uint64_t layerStart = nowNanos());
+    // Function to fill in the totals once the search stops
+    auto finishStats = [&]()
+    {
+        SEARCH_STAT(stats.nodesStored = pool.size();
+                    stats.memoryBytes = pool.capacity() * sizeof(SearchNode<State>) + visited.memoryBytes());
+    };
+    while (layerBegin < pool.size())
+    {
+        size_t layerEnd = pool.size();
+        SEARCH_STAT(stats.peakFrontier = max<uint64_t>(stats.peakFrontier, layerEnd - layerBegin));
+        for (size_t i = layerBegin; i < layerEnd; ++i)
+        {
+            if (isWin(pool[i].state) || isLoss(pool[i].state))
+            {
+                SEARCH_STAT(recordLayer(stats, 0, layerStart)); // Stopped before expanding the layer
+                finishStats();
+                visited.reportHitRate(searchReport());
+                return reconstructSolution(dungeon, pool, i);
+            }
+        }
+        size_t numChunks = (layerEnd - layerBegin + kChunkSize - 1) / kChunkSize;
+        if (chunkSuccessors.size() < numChunks)
+        {
+            chunkSuccessors.resize(numChunks);
+            chunkOrdinals.resize(numChunks);
+        }
+        chunkCounters.assign(numChunks, ExpansionCounters());
+        // Expand the layer and claim the key of every successor
+        workers.run(numChunks, [&](size_t chunk)
+                    {
+                        chunkSuccessors[chunk].clear();
+                        chunkOrdinals[chunk].clear();
+                        size_t begin = layerBegin + chunk * kChunkSize;
+                        size_t end = min(begin + kChunkSize, layerEnd);
+                        for (size_t i = begin; i < end; ++i)
+                        {
+                            uint64_t successorIndex = 0;
+                            forEachSuccessor(dungeon, pool[i].state, chunkCounters[chunk], [&](const State &successor, uint8_t action)
+                                             {
+                                                 uint64_t ordinal = (static_cast<uint64_t>(i) << kSuccessorBits) | successorIndex++;
+                                                 if (visited.claim(successor.hashKey, ordinal))
+                                                 {
+                                                     chunkSuccessors[chunk].push_back({successor, static_cast<uint32_t>(i), action});
+                                                     chunkOrdinals[chunk].push_back(ordinal);
+                                                 }
+                                                 return true; });
+                        } });
+        // Drop successors whose key was taken over by an earlier one
+        workers.run(numChunks, [&](size_t chunk)
+                    {
+                        vector<SearchNode<State>> &successors = chunkSuccessors[chunk];
+                        size_t kept = 0;
+                        for (size_t j = 0; j < successors.size(); ++j)
+                        {
+                            if (visited.holds(successors[j].state.hashKey, chunkOrdinals[chunk][j]))
+                            {
+                                successors[kept++] = successors[j];
+                            }
+                        }
+                        successors.resize(kept); });
+        // Append the next layer in serial order
+        offsets.assign(numChunks + 1, layerEnd);
+        for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            offsets[chunk + 1] = offsets[chunk] + chunkSuccessors[chunk].size();
+        }
+        pool.resize(offsets[numChunks]);
+        workers.run(numChunks, [&](size_t chunk)
+                    { copy(chunkSuccessors[chunk].begin(), chunkSuccessors[chunk].end(), pool.begin() + offsets[chunk]); });
+#ifndef NO_SEARCH_STATS
+        // Phase times are summed over the workers, so they measure CPU time rather than elapsed time
+        uint64_t generated = 0;
+        for (const auto &counters : chunkCounters)
+        {
+            stats.expansion.expansions += counters.expansions;
+            stats.expansion.timedExpansions += counters.timedExpansions;
+            stats.expansion.actManNanos += counters.actManNanos;
+            stats.expansion.monsterNanos += counters.monsterNanos;
+            generated += counters.successors;
+        }
+        stats.expansion.successors += generated;
+        stats.duplicatesPruned += generated - (pool.size() - layerEnd);
+        stats.nodesExpanded += layerEnd - layerBegin;
+        recordLayer(stats, layerEnd - layerBegin, layerStart);
+#endif
+        layerBegin = layerEnd;
+    }
+    finishStats();
+    visited.reportHitRate(searchReport());
+    return Solution<State>{initialState}; // No solution found
+}
+
+// Buffered writer for the spill files of the external-memory BFS
+// Integers are written as LEB128 varints, so sorted keys stored as deltas and small fields shrink to a few bytes
+class SpillWriter
+{
+public:
+    explicit SpillWriter(const string &filename) : file(filename, ios::binary | ios::trunc), name(filename)
+    {
+        if (!file.is_open())
+        {
+            cerr << "Error: Failed to create spill file " << name << "." << endl;
+            exit(EXIT_FAILURE);
+        }
+        buffer.reserve(kBufferSize);
+    }
+    ~SpillWriter()
+    {
+        close();
+    }
+
+    // Function to append one byte
+    void putByte(uint8_t value)
+    {
+        buffer.push_back(value);
+        if (buffer.size() >= kBufferSize)
+            flush();
+    }
+
+    // Function to append an unsigned integer as a varint
+    void putVarint(uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            putByte(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        putByte(static_cast<uint8_t>(value));
+    }
+
+    // Function to append a 64-bit value that does not compress (Zobrist keys)
+    void putFixed64(uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i, value >>= 8)
+            putByte(static_cast<uint8_t>(value));
+    }
+
+    // Function to write out the buffer and close the file
+    void close()
+    {
+        if (!file.is_open())
+            return;
+        flush();
+        file.close();
+    }
+
+    uint64_t bytesWritten() const
+    {
+        return written + buffer.size();
+    }
+
+private:
+    static const size_t kBufferSize = 1 << 16;
+    ofstream file;
+    string name;
+    vector<char> buffer;
+    uint64_t written = 0;
+
+    // Function to hand the buffered bytes to the file; a failed write (disk full) is fatal
+    void flush()
+    {
+        if (!file.write(buffer.data(), buffer.size()))
+        {
+            cerr << "Error: Failed to write spill file " << name << "." << endl;
+            exit(EXIT_FAILURE);
+        }
+        written += buffer.size();
+        buffer.clear();
+    }
+};
+
+// Buffered reader for files written by SpillWriter
+class SpillReader
+{
+public:
+    explicit SpillReader(const string &filename) : file(filename, ios::binary), buffer(kBufferSize)
+    {
+        if (!file.is_open())
+        {
+            cerr << "Error: Failed to open spill file " << filename << "." << endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // Function to read one byte; returns false at the end of the file
+    bool getByte(uint8_t &value)
+    {
+        if (pos == size && !refill())
+            return false;
+        value = buffer[pos++];
+        return true;
+    }
+
+    // Function to read a varint; returns false at the end of the file
+    bool getVarint(uint64_t &value)
+    {
+        value = 0;
+        uint8_t byte;
+        for (int shift = 0; getByte(byte); shift += 7)
+        {
+            value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80))
+                return true;
+        }
+        return false;
+    }
+
+    // Function to read a value written by putFixed64
+    bool getFixed64(uint64_t &value)
+    {
+        value = 0;
+        uint8_t byte;
+        for (int i = 0; i < 8; ++i)
+        {
+            if (!getByte(byte))
+                return false;
+            value |= static_cast<uint64_t>(byte) << (8 * i);
+        }
+        return true;
+    }
+
+private:
+    static const size_t kBufferSize = 1 << 16;
+    ifstream file;
+    vector<char> buffer;
+    size_t pos = 0;
+    size_t size = 0;
+
+    // Function to load the next block of the file
+    bool refill()
+    {
+        file.read(buffer.data(), buffer.size());
+        size = file.gcount();
+        pos = 0;
+        return size > 0;
+    }
+};
+
+// Function to write a node to a spill file: the key verbatim, everything else as varints
+// Monsters are sorted, so they are stored as deltas; parent is the rank of the parent in its layer file
+template <class State>
+void writeSpillNode(SpillWriter &out, const State &state, uint64_t parent, uint8_t action)
+{
+    out.putFixed64(state.hashKey);
+    out.putVarint(state.actManCell);
+    out.putVarint((static_cast<uint32_t>(state.score) << 1) ^ static_cast<uint32_t>(state.score >> 15)); // Zigzag
+    out.putByte((state.bulletFired ? 1 : 0) | (state.caught ? 2 : 0));
+    out.putByte(state.monsterCount);
+    uint32_t previous = 0;
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        out.putVarint(state.monsters[i] - previous);
+        previous = state.monsters[i];
+    }
+    out.putVarint(parent);
+    out.putByte(action);
+}
+
+// Function to read a node written by writeSpillNode; returns false at the end of the file
+template <class State>
+bool readSpillNode(SpillReader &in, State &state, uint64_t &parent, uint8_t &action)
+{
+    uint64_t cell, score, monster;
+    uint8_t flags, count;
+    state = {};
+    if (!in.getFixed64(state.hashKey) || !in.getVarint(cell) || !in.getVarint(score) || !in.getByte(flags) ||
+        !in.getByte(count) || count > State::kCapacity)
+        return false;
+    state.actManCell = cell;
+    state.score = static_cast<int16_t>((score >> 1) ^ -(score & 1));
+    state.bulletFired = flags & 1;
+    state.caught = flags & 2;
+    state.monsterCount = count;
+    uint32_t previous = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        if (!in.getVarint(monster))
+            return false;
+        previous += monster;
+        state.monsters[i] = previous;
+    }
+    return in.getVarint(parent) && in.getByte(action);
+}
+
+// Key of a generated successor and its position in generation order, as held in a sorted run
+struct SpillEntry
+{
+    uint64_t key;
+    uint64_t ordinal;
+
+    bool operator<(const SpillEntry &other) const
+    {
+        return key != other.key ? key < other.key : ordinal < other.ordinal;
+    }
+};
+
+// Names of the spill files of one search; every file handed out is removed when the search ends
+// The prefix carries the process id and a per-process search number, so searches running side by side
+// (batch workers, the server) never share a file.
+class SpillFiles
+{
+public:
+    explicit SpillFiles(const string &directory)
+        : prefix(directory + "/actman-spill-" + to_string(getpid()) + "-" + to_string(nextSearch++) + "-") {}
+    ~SpillFiles()
+    {
+        for (const auto &name : names)
+            remove(name.c_str());
+    }
+
+    // Function to get the path of a spill file
+    string path(const string &name)
+    {
+        string full = prefix + name;
+        if (find(names.begin(), names.end(), full) == names.end())
+            names.push_back(full);
+        return full;
+    }
+
+private:
+    static atomic<uint64_t> nextSearch;
+    string prefix;
+    vector<string> names;
+};
+
+atomic<uint64_t> SpillFiles::nextSearch{0};
+
+// Function to sort a buffer of successor keys, drop duplicates inside it and write it out as a run
+// Keys are stored as deltas, so a run of sorted keys compresses well below 16 bytes per entry
+void spillRun(vector<SpillEntry> &buffer, SpillFiles &files, vector<string> &runs, uint64_t &spilledBytes)
+{
+    if (buffer.empty())
+        return;
+    sort(buffer.begin(), buffer.end());
+    runs.push_back(files.path("run" + to_string(runs.size())));
+    SpillWriter out(runs.back());
+    uint64_t previous = 0;
+    for (size_t i = 0; i < buffer.size(); ++i)
+    {
+        if (i > 0 && buffer[i].key == buffer[i - 1].key)
+            continue; // The earlier ordinal already represents this key
+        out.putVarint(buffer[i].key - previous);
+        out.putVarint(buffer[i].ordinal);
+        previous = buffer[i].key;
+    }
+    spilledBytes += out.bytesWritten();
+    buffer.clear();
+}
+
+// Function to merge the runs of a layer against the keys of every earlier layer (delayed duplicate detection)
+// Writes the ordinals of the successors that survive to keptName, in key order, and rewrites the visited
+// file with their keys added. Returns the number of survivors.
+uint64_t mergeRuns(const vector<string> &runs, const string &visitedName, const string &mergedName,
+                   const string &keptName)
+{
+    struct Cursor
+    {
+        SpillReader reader;
+        SpillEntry entry;
+        explicit Cursor(const string &name) : reader(name), entry{0, 0} {}
+
+        // Function to step to the next entry of the run; returns false at its end
+        bool advance()
+        {
+            uint64_t delta;
+            if (!reader.getVarint(delta) || !reader.getVarint(entry.ordinal))
+                return false;
+            entry.key += delta;
+            return true;
+        }
+    };
+    vector<unique_ptr<Cursor>> cursors;
+    auto later = [&](size_t a, size_t b)
+    { return cursors[b]->entry < cursors[a]->entry; };
+    priority_queue<size_t, vector<size_t>, decltype(later)> heap(later);
+    for (const auto &run : runs)
+    {
+        cursors.emplace_back(new Cursor(run));
+        if (cursors.back()->advance())
+            heap.push(cursors.size() - 1);
+    }
+    SpillReader visited(visitedName);
+    SpillWriter merged(mergedName);
+    SpillWriter survivors(keptName);
+    uint64_t visitedKey = 0, delta, previous = 0, kept = 0;
+    bool visitedValid = visited.getVarint(delta);
+    visitedKey += delta;
+    auto emit = [&](uint64_t key)
+    {
+        merged.putVarint(key - previous);
+        previous = key;
+    };
+    while (!heap.empty())
+    {
+        uint64_t key = cursors[heap.top()]->entry.key;
+        uint64_t ordinal = cursors[heap.top()]->entry.ordinal; // Smallest ordinal of the key comes first
+        while (!heap.empty() && cursors[heap.top()]->entry.key == key)
+        {
+            size_t index = heap.top();
+            heap.pop();
+            if (cursors[index]->advance())
+                heap.push(index);
+        }
+        for (; visitedValid && visitedKey < key; visitedValid = visited.getVarint(delta), visitedKey += delta)
+            emit(visitedKey);
+        if (visitedValid && visitedKey == key)
+        {
+            continue; // Reached in an earlier layer
+        }
+        survivors.putVarint(ordinal);
+        ++kept;
+        emit(key);
+    }
+    for (; visitedValid; visitedValid = visited.getVarint(delta), visitedKey += delta)
+        emit(visitedKey);
+    return kept;
+}
+
+// Function to read the nodes on the path to a node from the layer files and rebuild its plan
+template <class State>
+Solution<State> reconstructSpilledSolution(const Dungeon &dungeon, SpillFiles &files, int depth, uint64_t rank)
+{
+    vector<SearchNode<State>> path(depth + 1);
+    for (int layer = depth; layer >= 0; --layer)
+    {
+        SpillReader in(files.path("layer" + to_string(layer)));
+        uint64_t parent = 0;
+        for (uint64_t i = 0; i <= rank; ++i)
+        {
+            if (!readSpillNode(in, path[layer].state, parent, path[layer].action))
+            {
+                cerr << "Error: Spill file for layer " << layer << " is truncated." << endl;
+                exit(EXIT_FAILURE);
+            }
+        }
+        rank = parent;
+    }
+    Solution<State> solution{path[depth].state};
+    for (int layer = depth; layer > 0; --layer)
+    {
+        recordStep(dungeon, solution, path[layer - 1].state, path[layer].action);
+    }
+    finishPlan(solution);
+    return solution;
+}
+
+// Function to parse a memory size such as 4G, 512M or 65536; returns 0 if it is malformed
+uint64_t parseByteSize(const string &text)
+{
+    size_t length = 0;
+    uint64_t value = 0;
+    try
+    {
+        value = stoull(text, &length);
+    }
+    catch (const exception &)
+    {
+        return 0;
+    }
+    string suffix = text.substr(length);
+    if (suffix == "K" || suffix == "k")
+        return value << 10;
+    if (suffix == "M" || suffix == "m")
+        return value << 20;
+    if (suffix == "G" || suffix == "g")
+        return value << 30;
+    return suffix.empty() ? value : 0;
+}
+
+// Function to perform breadth-first search with the frontier kept on disk, for searches that outgrow memory
+// Each layer lives in a file in the order bfs() would enqueue it. Successors are generated in that order,
+// their keys are buffered up to the memory limit and spilled as sorted runs, and the runs are merged
+// against a sorted file of every key seen so far. Only the surviving successors are copied to the next
+// layer, so the search returns the same solution as bfs(). Half of the memory limit holds the key buffer,
+// the other half one keep bit per successor for as many successors as fit; larger layers are copied in
+// windows of that many successors, each rereading the survivors' ordinals from disk.
+template <class State>
+Solution<State> externalBfs(const Dungeon &dungeon, const State &initialState, uint64_t memLimit, const string &spillDir,
+                     SearchStats &stats)
+{
+    const size_t capacity = max<uint64_t>(1 << 16, memLimit / 2 / sizeof(SpillEntry));
+    const uint64_t windowSize = max<uint64_t>(1 << 16, memLimit / 2 * 8); // Successors per window of keep bits
+    SpillFiles files(spillDir);
+    {
+        SpillWriter layer(files.path("layer0"));
+        writeSpillNode(layer, initialState, 0, NoAction);
+        SpillWriter visited(files.path("visited"));
+        visited.putVarint(initialState.hashKey);
+    }
+    vector<SpillEntry> buffer;
+    buffer.reserve(capacity);
+    uint64_t lookups = 0, dropped = 0, unique = 1, spilledBytes = 0;
+    SEARCH_STAT(uint64_t layerStart = nowNanos(); uint64_t peakKeepBytes = 0);
+    // Function to fill in the totals once the search stops
+    auto finishStats = [&]()
+    {
+        SEARCH_STAT(stats.duplicatesPruned = dropped; stats.nodesStored = unique; stats.spilledBytes = spilledBytes;
+                    stats.memoryBytes = buffer.capacity() * sizeof(SpillEntry) + peakKeepBytes);
+    };
+    for (int depth = 0;; ++depth)
+    {
+        vector<string> runs;
+        uint64_t rank = 0, ordinal = 0;
+        {
+            SpillReader layer(files.path("layer" + to_string(depth)));
+            SpillWriter generated(files.path("generated"));
+            State state;
+            uint64_t parent;
+            uint8_t action;
+            for (; readSpillNode(layer, state, parent, action); ++rank)
+            {
+                if (isWin(state) || isLoss(state))
+                {
+                    SEARCH_STAT(recordLayer(stats, rank, layerStart));
+                    finishStats();
+                    searchReport() << "External BFS: " << lookups << " lookups, " << dropped << " duplicates dropped, " << unique
+                         << " unique states, " << spilledBytes << " bytes spilled" << endl;
+                    return reconstructSpilledSolution<State>(dungeon, files, depth, rank);
+                }
+                SEARCH_STAT(stats.nodesExpanded++);
+                forEachSuccessor(dungeon, state, stats.expansion, [&](const State &successor, uint8_t action)
+                                 {
+                                     writeSpillNode(generated, successor, rank, action);
+                                     buffer.push_back({successor.hashKey, ordinal++});
+                                     if (buffer.size() == capacity)
+                                         spillRun(buffer, files, runs, spilledBytes);
+                                     return true; });
+            }
+            spillRun(buffer, files, runs, spilledBytes);
+            spilledBytes += generated.bytesWritten();
+        }
+        SEARCH_STAT(stats.peakFrontier = max(stats.peakFrontier, rank));
+        if (rank == 0)
+            break; // The frontier is empty
+        // Keep the first successor of every key not seen in an earlier layer
+        uint64_t kept = mergeRuns(runs, files.path("visited"), files.path("merged"), files.path("kept"));
+        rename(files.path("merged").c_str(), files.path("visited").c_str());
+        for (const auto &run : runs)
+            remove(run.c_str());
+        lookups += ordinal;
+        dropped += ordinal - kept;
+        unique += kept;
+        // Copy the survivors to the next layer in generation order
+        SpillReader generated(files.path("generated"));
+        SpillWriter next(files.path("layer" + to_string(depth + 1)));
+        State state;
+        uint64_t parent;
+        uint8_t action;
+        vector<bool> keep;
+        uint64_t i = 0;
+        for (uint64_t windowBegin = 0; windowBegin < ordinal; windowBegin += windowSize)
+        {
+            uint64_t windowEnd = min(ordinal, windowBegin + windowSize);
+            keep.assign(windowEnd - windowBegin, false);
+            SEARCH_STAT(peakKeepBytes = max(peakKeepBytes, (windowEnd - windowBegin + 7) / 8));
+            SpillReader survivors(files.path("kept"));
+            for (uint64_t survivor; survivors.getVarint(survivor);)
+            {
+                if (survivor >= windowBegin && survivor < windowEnd)
+                    keep[survivor - windowBegin] = true;
+            }
+            for (; i < windowEnd && readSpillNode(generated, state, parent, action); ++i)
+            {
+                if (keep[i - windowBegin])
+                    writeSpillNode(next, state, parent, action);
+            }
+        }
+        spilledBytes += next.bytesWritten();
+        SEARCH_STAT(recordLayer(stats, rank, layerStart));
+    }
+    finishStats();
+    searchReport() << "External BFS: " << lookups << " lookups, " << dropped << " duplicates dropped, " << unique
+         << " unique states, " << spilledBytes << " bytes spilled" << endl;
+    return Solution<State>{initialState}; // No solution found
+}
+
+// Heuristic value of states from which no win is possible
+const uint32_t kInfiniteCost = UINT32_MAX;
+
+// Memory a search may spend caching the distance fields of its heuristic
+const size_t kHeuristicFieldBudget = 64 << 20;
+
+// Wall-aware king-move distance fields over the static grid, computed per source cell on first use
+// A field per cell is quadratic in the dungeon size, so the cache starts over when it would outgrow
+// kHeuristicFieldBudget, the same way the greedy monster model's cache does.
+struct DistanceFields
+{
+    const Dungeon &dungeon;
+    vector<vector<uint16_t>> fields; // Indexed by source cell; empty until requested
+    size_t cachedBytes = 0;
+    vector<uint32_t> frontier;
+
+    explicit DistanceFields(const Dungeon &d) : dungeon(d), fields(static_cast<size_t>(d.numRows) * d.numCols) {}
+
+    // Function to get the distance from a cell to every other cell; valid until the next call
+    const vector<uint16_t> &from(uint32_t source)
+    {
+        if (!fields[source].empty())
+        {
+            return fields[source];
+        }
+        size_t fieldBytes = fields.size() * sizeof(uint16_t);
+        if (cachedBytes + fieldBytes > kHeuristicFieldBudget)
+        {
+            for (auto &field : fields)
+                vector<uint16_t>().swap(field);
+            cachedBytes = 0;
+        }
+        vector<uint16_t> &field = fields[source];
+        field.resize(fields.size());
+        computeKingDistances(dungeon, source, field.data(), frontier);
+        cachedBytes += fieldBytes;
+        return field;
+    }
+};
+
+// Function to compute a lower bound on the plies needed to win from a state
+// Every ply has at most one kill event, removing all monsters on one cell, and at most one monster
+// move, which can merge two occupied cells; so k plies clear at most 2k - 1 cells. A monster at
+// king distance d needs ceil((d + 1) / 2) plies to be stepped on, since Act-Man and the monster each
+// close at most one step per ply and Act-Man makes the final step. An unspent bullet can instead
+// take out the farthest monster in one ply, so the bound then uses the second farthest.
+template <class State>
+uint32_t heuristic(DistanceFields &distances, const State &state)
+{
+    if (state.monsterCount == 0)
+    {
+        return 0;
+    }
+    const vector<uint16_t> &field = distances.from(state.actManCell);
+    uint32_t bound = 0;
+    uint32_t runnerUp = 0; // Second largest per-monster bound
+    uint32_t occupiedCells = 0;
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        uint32_t cell = monsterCell(state.monsters[i]);
+        if (field[cell] == kUnreachable)
+        {
+            return kInfiniteCost; // Walled off, can never be eliminated
+        }
+        uint32_t monsterBound = (field[cell] + 2) / 2;
+        runnerUp = max(runnerUp, min(bound, monsterBound));
+        bound = max(bound, monsterBound);
+        if (i == 0 || monsterCell(state.monsters[i - 1]) != cell)
+        {
+            occupiedCells++;
+        }
+    }
+    if (!state.bulletFired)
+    {
+        bound = max<uint32_t>(runnerUp, 1);
+    }
+    return max(bound, (occupiedCells + 2) / 2);
+}
+
+// Function to count the points a plan has lost on its way to a state, against eliminating every monster
+// on its own: each paid move or shot loses one, and each monster beyond the first that one elimination
+// takes out loses the 5 it would have earned alone. A win scores the initial score plus 5 per monster
+// minus this, so the best-scoring plan is the one losing fewest points. The count never falls along a
+// plan, and it depends on the state alone, so every path to a configuration has lost the same points.
+template <class State>
+uint32_t pointsLost(const State &initialState, const State &state)
+{
+    return initialState.score + 5 * (initialState.monsterCount - state.monsterCount) - state.score;
+}
+
+// Function to bound the points still to be lost before a win: every monster left needs an elimination,
+// which either costs the paid move or shot that makes it or forgoes 5 points by sharing one
+template <class State>
+uint32_t pointsBound(const State &state)
+{
+    return state.monsterCount;
+}
+
+// Cost of the A* and IDA* searches: points lost, then plies, compared as one number
+// Walking into a wall is free, so among the plans losing fewest points the plies pick a shortest one.
+// Plies also keep every IDA* pass finite, which free moves alone would not.
+const uint64_t kInfinitePlanCost = UINT64_MAX;
+
+// Function to combine points and plies into a plan cost, ordered on points first
+uint64_t planCost(uint32_t points, uint32_t plies)
+{
+    return static_cast<uint64_t>(points) << 32 | plies;
+}
+
+// Function to bound the cost of the best win through a state reached in g plies; kInfinitePlanCost if there is none
+template <class State>
+uint64_t costBound(DistanceFields &distances, const State &initialState, const State &state, uint32_t g)
+{
+    uint32_t h = heuristic(distances, state);
+    if (h == kInfiniteCost)
+    {
+        return kInfinitePlanCost;
+    }
+    return planCost(pointsLost(initialState, state) + pointsBound(state), g + h);
+}
+
+// Structure to hold an entry of the A* open list
+struct OpenEntry
+{
+    uint64_t f;    // Plan cost so far plus the bound on the cost still to come (see planCost)
+    uint32_t g;    // Plies so far
+    uint32_t node; // Index into the node pool
+};
+
+// Function to order the A* open list: lowest f, then deepest
+struct OpenEntryOrder
+{
+    bool operator()(const OpenEntry &a, const OpenEntry &b) const
+    {
+        if (a.f != b.f)
+            return a.f > b.f;
+        return a.g < b.g;
+    }
+};
+
+// Function to run A* on points lost; returns a best-scoring winning plan, the shortest among those
+// Under a budget the best-ranked node generated so far is kept, and its plan is returned when the budget runs out
+template <class State>
+Solution<State> astar(const Dungeon &dungeon, const State &initialState, SearchStats &stats, const SearchBudget &budget)
+{
+    DistanceFields distances(dungeon);
+    // Reused by the next search on this thread, like the BFS pool
+    static thread_local vector<SearchNode<State>> pool;
+    static thread_local DepthTable bestDepth;   // Fewest plies each configuration was reached in (points lost are fixed)
+    static thread_local vector<OpenEntry> open; // Binary heap ordered by OpenEntryOrder
+    static thread_local vector<SearchNode<State>> successors; // Survivors of the first pruning test, for the second
+    recycle(pool);
+    bestDepth.clear();
+    recycle(open);
+    OpenEntryOrder order;
+    size_t expanded = 0;
+    bool limited = budget.limited();
+    uint32_t best = 0; // Under a budget: the node outranking every other one generated so far
+    uint64_t f = costBound(distances, initialState, initialState, 0);
+    if (f != kInfinitePlanCost)
+    {
+        pool.push_back({initialState, kNoParent, NoAction});
+        bestDepth.set(initialState.hashKey, 0);
+        open.push_back({f, 0, 0});
+    }
+    // Function to fill in the totals once the search stops
+    auto finishStats = [&]()
+    {
+        SEARCH_STAT(stats.nodesExpanded = expanded; stats.nodesStored = pool.size();
+                    stats.memoryBytes = pool.capacity() * sizeof(SearchNode<State>) + open.capacity() * sizeof(OpenEntry) +
+                                        bestDepth.memoryBytes());
+    };
+    while (!open.empty())
+    {
+        SEARCH_STAT(stats.peakFrontier = max<uint64_t>(stats.peakFrontier, open.size()));
+        pop_heap(open.begin(), open.end(), order);
+        OpenEntry entry = open.back();
+        open.pop_back();
+        const State currentState = pool[entry.node].state;
+        if (bestDepth.depth(currentState.hashKey) < entry.g)
+        {
+            continue; // A shorter path to this configuration was expanded already
+        }
+        if (isWin(currentState))
+        {
+            finishStats();
+            searchReport() << "A*: " << expanded << " nodes expanded, " << pool.size() << " generated" << endl;
+            return reconstructSolution(dungeon, pool, entry.node);
+        }
+        if (limited && budget.exhausted(expanded))
+        {
+            finishStats();
+            searchReport() << "A*: " << expanded << " nodes expanded, " << pool.size() << " generated" << endl;
+            return bestSoFar(dungeon, pool, best, expanded);
+        }
+        expanded++;
+        // Losing states are dead ends and never copied. The depth lookups of the rest wait for a second pass:
+        // made straight away they stall on one cache miss after another, started here they overlap
+        successors.clear();
+        forEachSuccessor(dungeon, currentState, stats.expansion, [&](const State &successor, uint8_t action)
+                         {
+                             if (!isLoss(successor) || isWin(successor))
+                             {
+                                 bestDepth.prefetch(successor.hashKey);
+                                 successors.push_back({successor, entry.node, action});
+                             }
+                             return true; });
+        for (const SearchNode<State> &successor : successors)
+        {
+            if (bestDepth.depth(successor.state.hashKey) <= entry.g + 1)
+            {
+                SEARCH_STAT(stats.duplicatesPruned++);
+                continue;
+            }
+            uint64_t fSuccessor = costBound(distances, initialState, successor.state, entry.g + 1);
+            if (fSuccessor == kInfinitePlanCost)
+            {
+                continue;
+            }
+            bestDepth.set(successor.state.hashKey, entry.g + 1);
+            pool.push_back(successor);
+            if (limited && outranks(successor.state, pool[best].state))
+            {
+                best = pool.size() - 1;
+            }
+            open.push_back({fSuccessor, entry.g + 1, static_cast<uint32_t>(pool.size() - 1)});
+            push_heap(open.begin(), open.end(), order);
+        }
+    }
+    finishStats();
+    searchReport() << "A*: " << expanded << " nodes expanded, " << pool.size() << " generated" << endl;
+    return Solution<State>{initialState}; // No solution found
+}
+
+// Function to run one depth-first pass of IDA* below a plan cost bound (see planCost)
+// Successors are streamed by forEachSuccessor onto the stack, so the pass allocates nothing and uses
+// memory linear in depth. Returns the smallest f that exceeded
+// the bound, kInfinitePlanCost, or 0 once a win is found, in which case the plan is recorded into
+// solution (last step first) while the recursion unwinds.
+template <class State>
+uint64_t idaStarPass(const Dungeon &dungeon, DistanceFields &distances, const State &initialState, State &state,
+                     vector<uint64_t> &pathKeys, uint64_t bound, size_t &expanded, SearchStats &stats,
+                     Solution<State> &solution)
+{
+    if (isWin(state))
+    {
+        solution.finalState = state;
+        return 0;
+    }
+    uint64_t f = costBound(distances, initialState, state, pathKeys.size() - 1);
+    if (f == kInfinitePlanCost)
+    {
+        return kInfinitePlanCost;
+    }
+    if (f > bound)
+    {
+        return f;
+    }
+    expanded++;
+    SEARCH_STAT(stats.peakFrontier = max<uint64_t>(stats.peakFrontier, pathKeys.size()));
+    uint64_t nextBound = kInfinitePlanCost;
+    uint8_t winningAction = NoAction;
+    // Function to search below a successor; stops the stream on a win
+    auto explore = [&](const State &successor, uint8_t action)
+    {
+        uint64_t result = kInfinitePlanCost;
+        bool onPath = find(pathKeys.begin(), pathKeys.end(), successor.hashKey) != pathKeys.end(); // Only the current path is remembered
+        if (onPath)
+        {
+            SEARCH_STAT(stats.duplicatesPruned++);
+        }
+        else if (!isLoss(successor) || isWin(successor)) // Losing states are dead ends
+        {
+            pathKeys.push_back(successor.hashKey);
+            State next = successor;
+            result = idaStarPass(dungeon, distances, initialState, next, pathKeys, bound, expanded, stats, solution);
+            pathKeys.pop_back();
+        }
+        if (result == 0)
+        {
+            winningAction = action;
+            return false;
+        }
+        nextBound = min(nextBound, result);
+        return true;
+    };
+    if (!forEachSuccessor(dungeon, state, stats.expansion, explore))
+    {
+        recordStep(dungeon, solution, state, winningAction);
+        return 0;
+    }
+    return nextBound;
+}
+
+// Function to run IDA* on points lost; returns a best-scoring winning plan, the shortest among those
+template <class State>
+Solution<State> idaStar(const Dungeon &dungeon, const State &initialState, SearchStats &stats)
+{
+    DistanceFields distances(dungeon);
+    State state = initialState;
+    vector<uint64_t> pathKeys(1, initialState.hashKey);
+    size_t expanded = 0;
+    uint64_t bound = costBound(distances, initialState, initialState, 0);
+    // Function to fill in the totals once the search stops; only the current path is ever stored
+    auto finishStats = [&]()
+    {
+        SEARCH_STAT(stats.nodesExpanded = expanded; stats.nodesStored = stats.peakFrontier;
+                    stats.memoryBytes = pathKeys.capacity() * sizeof(uint64_t) + sizeof(State));
+    };
+    while (bound != kInfinitePlanCost)
+    {
+        Solution<State> solution{initialState};
+        uint64_t result = idaStarPass(dungeon, distances, initialState, state, pathKeys, bound, expanded, stats, solution);
+        if (result == 0)
+        {
+            finishStats();
+            searchReport() << "IDA*: " << expanded << " nodes expanded, final bound " << (bound >> 32) << " points lost in "
+                           << uint32_t(bound) << " plies" << endl;
+            finishPlan(solution);
+            return solution;
+        }
+        bound = result;
+    }
+    finishStats();
+    searchReport() << "IDA*: " << expanded << " nodes expanded, no solution" << endl;
+    return Solution<State>{initialState}; // No solution found
+}
+
+// Deepest iteration --depth accepts for minimax and expectimax, and their defaults; expectimax cannot
+// prune, so it defaults to fewer plies
+const int kMaxSearchDepth = 64;
+const int kDefaultMinimaxDepth = 8;
+const int kDefaultExpectimaxDepth = 6;
+
+// Values of the adversarial searches: a win or loss outweighs any evaluation, and sooner wins rank
+// higher and sooner losses lower, so decisive values sit in bands of kPlyBand per ply from the root
+const int32_t kWinValue = 1 << 30;
+const int32_t kPlyBand = 1 << 16;
+const int32_t kDecisiveValue = kWinValue - (kMaxSearchDepth + 1) * kPlyBand;
+
+// Kinds of bound a table entry holds on a node's value
+enum BoundKind : uint8_t
+{
+    ExactBound,
+    LowerBound, // The node failed high: its value is at least the stored one
+    UpperBound  // The node failed low: its value is at most the stored one
+};
+
+// Structure to hold one Act-Man node of the adversarial search in the bounded transposition table
+struct BoundEntry
+{
+    uint64_t key;      // State key
+    uint64_t replyKey; // Key after the best action and the monster reply expected to it
+    int32_t value;     // Decisive values are stored relative to the node, see BoundedTable::store
+    uint32_t search;   // Search the entry was stored by; entries of earlier searches are empty
+    uint8_t depth;     // Plies searched below the node
+    uint8_t bound;     // BoundKind of value
+    uint8_t action;    // ActionCode of the best action
+};
+
+// Fixed-size table of searched Act-Man nodes with a bound on their value and their best action, used
+// by minimax and expectimax. Within a search a slot keeps the deeper of two results. A per-thread
+// search counter marks older entries empty, so the table is never cleared between searches.
+class BoundedTable
+{
+public:
+    BoundedTable() : slots(kSlots) {}
+
+    // Function to start a new search, which empties the table
+    void begin()
+    {
+        ++search;
+        used = 0;
+    }
+
+    // Function to find the entry of a state; returns nullptr if it has none
+    const BoundEntry *probe(uint64_t key) const
+    {
+        const BoundEntry &entry = slots[key & (kSlots - 1)];
+        return entry.search == search && entry.key == key ? &entry : nullptr;
+    }
+
+    // Function to store a node searched at a ply from the root
+    // Decisive values are kept as the distance from the node, so a transposition at another ply
+    // reads back the right distance from its own root.
+    void store(uint64_t key, int ply, int depth, int32_t value, BoundKind bound, uint8_t action, uint64_t replyKey)
+    {
+        BoundEntry &entry = slots[key & (kSlots - 1)];
+        if (entry.search == search && entry.depth > depth)
+        {
+            return;
+        }
+        used += entry.search != search;
+        if (value >= kDecisiveValue)
+            value += ply * kPlyBand;
+        else if (value <= -kDecisiveValue)
+            value -= ply * kPlyBand;
+        entry = {key, replyKey, value, search, static_cast<uint8_t>(depth), bound, action};
+    }
+
+    // Function to read an entry's value back at the ply its state was reached at
+    static int32_t value(const BoundEntry &entry, int ply)
+    {
+        if (entry.value >= kDecisiveValue)
+            return entry.value - ply * kPlyBand;
+        if (entry.value <= -kDecisiveValue)
+            return entry.value + ply * kPlyBand;
+        return entry.value;
+    }
+
+    // Function to get the number of slots filled by the current search
+    size_t size() const
+    {
+        return used;
+    }
+
+    size_t memoryBytes() const
+    {
+        return slots.size() * sizeof(BoundEntry);
+    }
+
+private:
+    static const size_t kSlots = kReusableBytes / sizeof(BoundEntry);
+    static_assert((kSlots & (kSlots - 1)) == 0, "slots are indexed by masking the key");
+    vector<BoundEntry> slots;
+    uint32_t search = 0;
+    size_t used = 0;
+};
+
+// Structure to hold what one minimax or expectimax search shares between its nodes
+struct AdversarialSearch
+{
+    const Dungeon &dungeon;
+    DistanceFields distances; // For the evaluation
+    BoundedTable &table;
+    const SearchBudget &budget;
+    SearchStats &stats;
+    bool expectimax;                                // Average over monster replies instead of taking the worst
+    vector<int32_t> actionHistory;                  // Cutoffs caused per Act-Man cell and move code, weighted by depth
+    vector<int32_t> replyHistory;                   // Cutoffs caused per monster cell and king step
+    uint8_t actionKillers[kMaxSearchDepth][2];      // Last two move codes that caused a cutoff at each ply
+    uint32_t replyKillers[kMaxSearchDepth][2];      // Last two monster steps (cell * 9 + step) that did
+    uint64_t expanded = 0;
+    bool aborted = false; // The budget ran out; every node returns at once and the iteration is dropped
+
+    AdversarialSearch(const Dungeon &d, BoundedTable &t, const SearchBudget &b, SearchStats &s, bool e)
+        : dungeon(d), distances(d), table(t), budget(b), stats(s), expectimax(e),
+          actionHistory(static_cast<size_t>(d.numRows) * d.numCols * 8, 0),
+          replyHistory(static_cast<size_t>(d.numRows) * d.numCols * 9, 0)
+    {
+        fill(&actionKillers[0][0], &actionKillers[0][0] + 2 * kMaxSearchDepth, NoAction);
+        fill(&replyKillers[0][0], &replyKillers[0][0] + 2 * kMaxSearchDepth, UINT32_MAX);
+    }
+};
+
+// Function to evaluate a state the search stops at without a result
+// Points of score, monsters left and the wall-aware lower bound on plies to a win all count, so the
+// search steers towards eliminations it can make soon without spending score on them.
+template <class State>
+int32_t evaluate(AdversarialSearch &search, const State &state)
+{
+    uint32_t pliesToWin = min<uint32_t>(heuristic(search.distances, state), 1000); // Walled-off monsters cap it
+    return 4 * state.score - 40 * state.monsterCount - 8 * static_cast<int32_t>(pliesToWin);
+}
+
+// Function to remember a move that caused a cutoff in a killer slot pair, most recent first
+template <class Move>
+void addKiller(Move (&killers)[2], Move move)
+{
+    if (killers[0] != move)
+    {
+        killers[1] = killers[0];
+        killers[0] = move;
+    }
+}
+
+template <class State>
+int32_t monsterNode(AdversarialSearch &search, State &state, int depth, int ply, int32_t alpha, int32_t beta,
+                    uint64_t &replyKey);
+
+// Function to search an Act-Man node: the best value of his actions, each answered by the monsters
+// Moves are made and unmade on one shared state, as in IDA*. Actions are tried table move first, then
+// the killers of the ply, then by history. Minimax returns a fail-soft value for the window
+// (alpha, beta); expectimax ignores the window and only takes table entries of exact values.
+template <class State>
+int32_t actManNode(AdversarialSearch &search, State &state, int depth, int ply, int32_t alpha, int32_t beta)
+{
+    if (isWin(state))
+    {
+        return kWinValue - ply * kPlyBand + state.score; // Among wins as soon, the higher score
+    }
+    if (isLoss(state))
+    {
+        return -kWinValue + ply * kPlyBand;
+    }
+    if (depth == 0)
+    {
+        return evaluate(search, state);
+    }
+    const BoundEntry *entry = search.table.probe(state.hashKey);
+    uint8_t tableCode = NoAction;
+    if (entry)
+    {
+        tableCode = entry->action == NoAction ? FireNorth : entry->action & ~EliminateFlag;
+        int32_t value = BoundedTable::value(*entry, ply);
+        // Entries only end the node when they prove it lies outside the window, so a node on the
+        // principal line is always searched and stores its best action
+        bool cutoff = search.expectimax ? entry->bound == ExactBound
+                                        : (entry->bound != UpperBound && value >= beta) ||
+                                              (entry->bound != LowerBound && value <= alpha);
+        if (ply > 0 && entry->depth >= depth && cutoff)
+        {
+            SEARCH_STAT(search.stats.duplicatesPruned++);
+            return value;
+        }
+    }
+    if (search.budget.limited() && search.budget.exhausted(search.expanded))
+    {
+        search.aborted = true;
+        return 0;
+    }
+    search.expanded++;
+    SEARCH_STAT(search.stats.peakFrontier = max<uint64_t>(search.stats.peakFrontier, ply + 1));
+    // Order the actions; a spent bullet leaves one fire code, which stands for waiting a ply
+    uint8_t codes[8];
+    int32_t order[8];
+    int numCodes = 0;
+    const int32_t *history = &search.actionHistory[static_cast<size_t>(state.actManCell) * 8];
+    for (int code = MoveNorth; code <= FireWest; ++code)
+    {
+        codes[numCodes] = code;
+        order[numCodes++] = code == tableCode                        ? INT32_MAX
+                            : code == search.actionKillers[ply][0] ? INT32_MAX - 1
+                            : code == search.actionKillers[ply][1] ? INT32_MAX - 2
+                                                                   : history[code];
+        if (code >= FireNorth && state.bulletFired)
+        {
+            break;
+        }
+    }
+    for (int i = 1; i < numCodes; ++i) // Insertion sort, highest order first, stable for ties
+    {
+        for (int j = i; j > 0 && order[j] > order[j - 1]; --j)
+        {
+            swap(order[j], order[j - 1]);
+            swap(codes[j], codes[j - 1]);
+        }
+    }
+    int32_t originalAlpha = alpha;
+    int32_t bestValue = INT32_MIN;
+    uint8_t bestAction = NoAction;
+    uint64_t bestReply = 0;
+    UndoRecord<State> undo;
+    for (int i = 0; i < numCodes; ++i)
+    {
+        uint8_t action;
+        if (codes[i] < FireNorth)
+        {
+            withMoves(search.dungeon, [&](const auto &moves)
+                      { makeActManMove(moves, state, static_cast<Direction>(codes[i]), action, undo); });
+        }
+        else
+        {
+            withMoves(search.dungeon, [&](const auto &moves)
+                      { makeFireBullet(moves, state, static_cast<Direction>(codes[i] - FireNorth), action, undo); });
+        }
+        uint64_t replyKey;
+        int32_t value = monsterNode(search, state, depth, ply, alpha, beta, replyKey);
+        unmakeMove(search.dungeon, state, undo);
+        if (search.aborted)
+        {
+            return 0;
+        }
+        if (value > bestValue)
+        {
+            bestValue = value;
+            bestAction = action;
+            bestReply = replyKey;
+        }
+        if (search.expectimax)
+        {
+            continue;
+        }
+        if (bestValue >= beta)
+        {
+            addKiller(search.actionKillers[ply], codes[i]);
+            search.actionHistory[static_cast<size_t>(state.actManCell) * 8 + codes[i]] += depth * depth;
+            break;
+        }
+        alpha = max(alpha, bestValue);
+    }
+    BoundKind bound = search.expectimax || (bestValue > originalAlpha && bestValue < beta) ? ExactBound
+                      : bestValue >= beta                                                    ? LowerBound
+                                                                                             : UpperBound;
+    search.table.store(state.hashKey, ply, depth, bestValue, bound, bestAction, bestReply);
+    return bestValue;
+}
+
+// Function to search the monsters' answer to the action just made on state
+// Minimax takes the reply worst for Act-Man, trying catches first, then the ply's killers, then by
+// history; expectimax averages over every reply as equally likely. replyKey is set to the key after
+// the reply the expected line follows: the worst one, or for expectimax the one nearest the average.
+template <class State>
+int32_t monsterNode(AdversarialSearch &search, State &state, int depth, int ply, int32_t alpha, int32_t beta,
+                    uint64_t &replyKey)
+{
+    const Dungeon &dungeon = search.dungeon;
+    UndoRecord<State> undo;
+    if (dungeon.monsterModel == GreedyMonsters)
+    {
+        withMoves(dungeon, [&](const auto &moves)
+                  { makeGreedyMonsterMoves(moves, state, undo); });
+        SEARCH_STAT(search.stats.expansion.successors++);
+        replyKey = state.hashKey;
+        int32_t value = actManNode(search, state, depth - 1, ply + 1, alpha, beta);
+        unmakeMove(dungeon, state, undo);
+        return value;
+    }
+    // Every monster step, in generation order, with its place in the minimax search order
+    struct Reply
+    {
+        uint8_t index;
+        uint32_t cell;
+        uint32_t step; // Monster cell * 9 + king step, for the killers and history
+        int32_t order;
+    };
+    Reply replies[State::kCapacity * 8];
+    int numReplies = 0;
+    withMoves(dungeon, [&](const auto &moves)
+              {
+                  for (int i = 0; i < state.monsterCount; ++i)
+                  {
+                      uint32_t cell = monsterCell(state.monsters[i]);
+                      int monsterRow = cell / dungeon.numCols;
+                      int monsterCol = cell % dungeon.numCols;
+                      moves.forEachNeighbour(cell, [&](uint32_t newCell)
+                                             {
+                                                 int newRow = newCell / dungeon.numCols;
+                                                 int dr = newRow - monsterRow;
+                                                 int dc = static_cast<int>(newCell) - newRow * dungeon.numCols - monsterCol;
+                                                 uint32_t step = cell * 9 + (dr + 1) * 3 + dc + 1;
+                                                 int32_t order = newCell == state.actManCell                ? INT32_MAX
+                                                                 : step == search.replyKillers[ply][0] ? INT32_MAX - 1
+                                                                 : step == search.replyKillers[ply][1] ? INT32_MAX - 2
+                                                                                                       : search.replyHistory[step];
+                                                 replies[numReplies++] = {static_cast<uint8_t>(i), newCell, step, order};
+                                             });
+                  } });
+    if (numReplies == 0)
+    {
+        // No monster left or none can move: Act-Man's action stands on its own
+        SEARCH_STAT(search.stats.expansion.successors++);
+        replyKey = state.hashKey;
+        return actManNode(search, state, depth - 1, ply + 1, alpha, beta);
+    }
+    SEARCH_STAT(search.stats.expansion.successors += numReplies);
+    if (search.expectimax)
+    {
+        int32_t values[State::kCapacity * 8];
+        uint64_t keys[State::kCapacity * 8];
+        int64_t total = 0;
+        for (int i = 0; i < numReplies; ++i)
+        {
+            makeMonsterMove(dungeon, state, replies[i].index, replies[i].cell, undo);
+            keys[i] = state.hashKey;
+            values[i] = actManNode(search, state, depth - 1, ply + 1, -kWinValue, kWinValue);
+            unmakeMove(dungeon, state, undo);
+            if (search.aborted)
+            {
+                return 0;
+            }
+            total += values[i];
+        }
+        int32_t average = total / numReplies;
+        int nearest = 0;
+        for (int i = 1; i < numReplies; ++i)
+        {
+            if (llabs(int64_t(values[i]) - average) < llabs(int64_t(values[nearest]) - average))
+                nearest = i;
+        }
+        replyKey = keys[nearest];
+        return average;
+    }
+    stable_sort(replies, replies + numReplies, [](const Reply &a, const Reply &b)
+                { return a.order > b.order; });
+    int32_t worstValue = INT32_MAX;
+    for (int i = 0; i < numReplies; ++i)
+    {
+        makeMonsterMove(dungeon, state, replies[i].index, replies[i].cell, undo);
+        uint64_t key = state.hashKey;
+        int32_t value = actManNode(search, state, depth - 1, ply + 1, alpha, beta);
+        unmakeMove(dungeon, state, undo);
+        if (search.aborted)
+        {
+            return 0;
+        }
+        if (value < worstValue)
+        {
+            worstValue = value;
+            replyKey = key;
+        }
+        if (worstValue <= alpha)
+        {
+            addKiller(search.replyKillers[ply], replies[i].step);
+            search.replyHistory[replies[i].step] += depth * depth;
+            break;
+        }
+        beta = min(beta, worstValue);
+    }
+    return worstValue;
+}
+
+// Function to read the expected line of play out of the table, replaying it from the initial state
+// Each step takes the stored best action and the reply the search expected to it, for at most depth plies.
+template <class State>
+Solution<State> expectedLine(AdversarialSearch &search, const State &initialState, int depth)
+{
+    Solution<State> solution{initialState};
+    ExpansionCounters counters;
+    State state = initialState;
+    vector<SearchNode<State>> successors;
+    for (int ply = 0; ply < depth && !isWin(state) && !isLoss(state); ++ply)
+    {
+        const BoundEntry *entry = search.table.probe(state.hashKey);
+        if (!entry)
+        {
+            break; // Overwritten by a deeper node of another state
+        }
+        generateSuccessors(search.dungeon, state, counters, successors);
+        auto next = find_if(successors.begin(), successors.end(), [&](const SearchNode<State> &node)
+                            { return node.action == entry->action && node.state.hashKey == entry->replyKey; });
+        if (next == successors.end())
+        {
+            break;
+        }
+        recordStep(search.dungeon, solution, state, next->action);
+        state = next->state;
+    }
+    solution.finalState = state;
+    return solution;
+}
+
+// Function to run iterative-deepening minimax with alpha-beta pruning, or expectimax, over plies
+// Minimax treats the monsters as an adversary choosing the reply worst for Act-Man, so a value above
+// a loss guarantees he survives maxDepth plies whatever they do; expectimax takes every reply as
+// equally likely. Each iteration searches one ply deeper, ordered by the table, killers and history
+// the previous ones left. The result is the line of play expected by the deepest completed iteration;
+// when the budget runs out the iteration in progress is dropped and the solution is marked partial.
+template <class State>
+Solution<State> adversarialSearch(const Dungeon &dungeon, const State &initialState, bool expectimax, int maxDepth,
+                           SearchStats &stats, const SearchBudget &budget)
+{
+    static thread_local BoundedTable table; // Reused by the next search on this thread
+    table.begin();
+    AdversarialSearch search(dungeon, table, budget, stats, expectimax);
+    const char *name = expectimax ? "Expectimax" : "Minimax";
+    Solution<State> solution{initialState};
+    int completed = 0;
+    int32_t value = 0;
+    SEARCH_STAT(uint64_t layerStart = nowNanos(); stats.layers.push_back({0, 0})); // Layer d: the d-ply iteration
+    for (int depth = 1; depth <= maxDepth; ++depth)
+    {
+        SEARCH_STAT(uint64_t iterationStart = search.expanded);
+        State state = initialState;
+        int32_t iterationValue = actManNode(search, state, depth, 0, -kWinValue, kWinValue);
+        if (search.aborted)
+        {
+            break;
+        }
+        SEARCH_STAT(recordLayer(stats, search.expanded - iterationStart, layerStart));
+        completed = depth;
+        value = iterationValue;
+        solution = expectedLine(search, initialState, depth);
+        if (value >= kDecisiveValue || value <= -kDecisiveValue)
+        {
+            break; // Proven win or loss: deeper iterations cannot change it
+        }
+    }
+    SEARCH_STAT(stats.nodesExpanded = search.expanded; stats.nodesStored = table.size();
+                stats.memoryBytes = table.memoryBytes() + (search.actionHistory.size() + search.replyHistory.size()) * sizeof(int32_t));
+    solution.partial = search.aborted;
+    searchReport() << name << ": " << search.expanded << " nodes expanded, depth " << completed << " of " << maxDepth
+                   << " completed, value " << value;
+    if (value >= kDecisiveValue)
+    {
+        searchReport() << " (win in " << (kWinValue - value + kPlyBand - 1) / kPlyBand << " plies)";
+    }
+    else if (value <= -kDecisiveValue)
+    {
+        searchReport() << " (loss in " << (value + kWinValue) / kPlyBand << " plies)";
+    }
+    else if (!expectimax && completed > 0)
+    {
+        searchReport() << " (survives " << completed << " plies against any monster moves)";
+    }
+    searchReport() << endl;
+    if (search.aborted)
+    {
+        searchReport() << "Search budget exhausted after " << search.expanded << " expansions; returning the line of depth "
+                       << completed << endl;
+    }
+    return solution;
+}
+
+// Function to set up a dungeon and its initial state from a parsed map; returns false and sets error if
+// the map has more monsters than a state can hold
+template <class State>
+bool buildDungeon(DungeonFile &file, Dungeon &dungeon, State &initialState, string &error)
+{
+    if (file.monsters.size() > State::kCapacity)
+    {
+        error = "Dungeon has " + to_string(file.monsters.size()) + " monsters; at most " + to_string(kWideMonsters) +
+                " are supported.";
+        return false;
+    }
+    initialState = {};
+    int numRows = file.numRows;
+    int numCols = file.numCols;
+    dungeon.numRows = numRows;
+    dungeon.numCols = numCols;
+    dungeon.grid = move(file.grid); // Walls and floor markings such as '@'; entities are cleared below
+    initZobrist(dungeon);
+    initialState.actManCell = file.actManCell;
+    dungeon.grid[file.actManCell] = ' ';
+    vector<uint32_t> monsters;
+    for (const auto &monster : file.monsters)
+    {
+        monsters.push_back(packMonster(monster.first, monster.second));
+        dungeon.grid[monster.first] = ' ';
+    }
+    dungeon.wallRuns = buildWallRuns(numRows, numCols, [&](int row, int col)
+                                     { return dungeon.grid[row * numCols + col] == '#'; });
+    dungeon.board = buildSmallBoard(numRows, numCols, [&](int row, int col)
+                                    { return dungeon.grid[row * numCols + col] == '#'; });
+    dungeon.kingSteps.resize(static_cast<size_t>(dungeon.board.words) * numRows * numCols);
+    kingNeighboursOnBoard(dungeon.board, dungeon.kingSteps.data());
+    sort(monsters.begin(), monsters.end());
+    copy(monsters.begin(), monsters.end(), initialState.monsters);
+    initialState.monsterCount = monsters.size();
+    initialState.score = 50;
+    initialState.bulletFired = false; // Initialize bullet fired flag
+    initialState.caught = false;
+    initialState.hashKey = computeHashKey(dungeon, initialState);
+    return true;
+}
+
+// Function to call f(initialState) with an empty initial state of the type that fits a dungeon's monsters
+// Dungeons with up to MAX_MONSTERS monsters are solved with the compact state, larger ones with the wide
+// state, at the cost of a bigger node in every search. f fills the state with buildDungeon.
+template <class F>
+auto withStateFor(const DungeonFile &file, F f)
+{
+    if (file.monsters.size() <= CompactState::kCapacity)
+    {
+        return f(CompactState{});
+    }
+    return f(WideState{});
+}
+
+// Function to read input from file
+void readInputFromFile(const string &filename, DungeonFile &file)
+{
+    string error;
+    if (!loadDungeonFile(filename, file, error))
+    {
+        cerr << "Error: " << error << endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Function to draw a state on top of the static grid, one string per dungeon row
+template <class State>
+vector<string> renderLayout(const Dungeon &dungeon, const State &state, int64_t bulletMark)
+{
+    vector<string> layout(dungeon.numRows);
+    for (int i = 0; i < dungeon.numRows; ++i)
+    {
+        layout[i].assign(dungeon.grid.begin() + i * dungeon.numCols, dungeon.grid.begin() + (i + 1) * dungeon.numCols);
+    }
+    if (bulletMark >= 0)
+    {
+        layout[bulletMark / dungeon.numCols][bulletMark % dungeon.numCols] = '@';
+    }
+    for (int i = 0; i < state.monsterCount; ++i)
+    {
+        uint32_t cell = monsterCell(state.monsters[i]);
+        layout[cell / dungeon.numCols][cell % dungeon.numCols] = monsterType(state.monsters[i]);
+    }
+    layout[state.actManCell / dungeon.numCols][state.actManCell % dungeon.numCols] = state.caught ? 'X' : 'A';
+    return layout;
+}
+
+// Function to write a solution in the output file format: the actions, the score and the final layout
+template <class State>
+void writeSolution(ostream &out, const Dungeon &dungeon, const Solution<State> &solution)
+{
+    for (const auto &action : solution.actions)
+    {
+        out << action << '\n';
+    }
+    out << "Score: " << solution.finalState.score << '\n';
+    for (const auto &row : renderLayout(dungeon, solution.finalState, solution.bulletMark))
+    {
+        out << row << '\n';
+    }
+}
+
+// Function to write output to file; returns false and sets error if the file cannot be written
+template <class State>
+bool writeOutputToFile(const string &filename, const Dungeon &dungeon, const Solution<State> &solution, string &error)
+{
+    ofstream outputFile(filename);
+    if (!outputFile.is_open())
+    {
+        error = "Failed to open output file.";
+        return false;
+    }
+    writeSolution(outputFile, dungeon, solution);
+    outputFile.close();
+    if (!outputFile)
+    {
+        error = "Failed to write output file.";
+        return false;
+    }
+    return true;
+}
+
+// Function to write the search counters as JSON for --stats
+template <class State>
+void writeStatsFile(const string &filename, const SearchStats &stats, const Solution<State> &solution, int numThreads)
+{
+    ofstream statsFile(filename);
+    if (!statsFile.is_open())
+    {
+        cerr << "Error: Failed to open stats file." << endl;
+        exit(EXIT_FAILURE);
+    }
+    const ExpansionCounters &expansion = stats.expansion;
+    double phaseScale = expansion.timedExpansions ? 1e-9 * expansion.expansions / expansion.timedExpansions : 0.0;
+    const char *result = isWin(solution.finalState) ? "win" : isLoss(solution.finalState) ? "loss" : "none";
+    statsFile << "{\n";
+    statsFile << "  \"algorithm\": \"" << stats.algorithm << "\",\n";
+    statsFile << "  \"threads\": " << numThreads << ",\n";
+    statsFile << "  \"result\": \"" << result << "\",\n";
+    statsFile << "  \"budget_exhausted\": " << (solution.partial ? "true" : "false") << ",\n";
+    statsFile << "  \"plan_length\": " << solution.actions.size() << ",\n";
+    statsFile << "  \"score\": " << solution.finalState.score << ",\n";
+    statsFile << "  \"total_seconds\": " << stats.totalNanos * 1e-9 << ",\n";
+    statsFile << "  \"nodes_expanded\": " << stats.nodesExpanded << ",\n";
+    statsFile << "  \"successors_generated\": " << stats.expansion.successors << ",\n";
+    statsFile << "  \"duplicates_pruned\": " << stats.duplicatesPruned << ",\n";
+    statsFile << "  \"nodes_stored\": " << stats.nodesStored << ",\n";
+    statsFile << "  \"peak_frontier\": " << stats.peakFrontier << ",\n";
+    statsFile << "  \"memory_bytes\": " << stats.memoryBytes << ",\n";
+    statsFile << "  \"bytes_per_node\": " << (stats.nodesStored ? stats.memoryBytes / stats.nodesStored : 0) << ",\n";
+    statsFile << "  \"search_node_bytes\": " << sizeof(SearchNode<State>) << ",\n";
+    statsFile << "  \"spilled_bytes\": " << stats.spilledBytes << ",\n";
+    statsFile << "  \"actman_phase_seconds\": " << expansion.actManNanos * phaseScale << ",\n"; // Scaled up from the samples
+    statsFile << "  \"monster_phase_seconds\": " << expansion.monsterNanos * phaseScale << ",\n";
+    statsFile << "  \"layers\": [";
+    for (size_t depth = 0; depth < stats.layers.size(); ++depth)
+    {
+        statsFile << (depth ? ",\n" : "\n") << "    {\"depth\": " << depth << ", \"nodes\": " << stats.layers[depth].nodes
+                  << ", \"seconds\": " << stats.layers[depth].nanos * 1e-9 << "}";
+    }
+    statsFile << (stats.layers.empty() ? "]\n" : "\n  ]\n");
+    statsFile << "}\n";
+    statsFile.close();
+}
+
+// Function to describe a search problem for the solution cache: the static grid, the initial state and
+// every option that changes the plan found (thread count and memory limit do not)
+template <class State>
+string canonicalProblem(const Dungeon &dungeon, const State &initialState, const string &algo, int depth)
+{
+    string canonical = "act-man plan v1 algo=" + algo;
+    if (algo == "minimax" || algo == "expectimax")
+    {
+        canonical += " depth=" + to_string(depth);
+    }
+    if (algo == "astar" || algo == "idastar")
+    {
+        canonical += " cost=points"; // Plans cached while these searches minimised plies do not match
+    }
+    canonical += dungeon.monsterModel == GreedyMonsters ? " monsters=greedy\n" : " monsters=any\n";
+    canonical += to_string(dungeon.numRows) + " " + to_string(dungeon.numCols) + "\n";
+    canonical.append(dungeon.grid.begin(), dungeon.grid.end());
+    canonical += "\nactman " + to_string(initialState.actManCell) + " score " + to_string(initialState.score) +
+                 " bullet " + to_string(initialState.bulletFired) + " monsters";
+    for (int i = 0; i < initialState.monsterCount; ++i)
+    {
+        canonical += " " + to_string(initialState.monsters[i]);
+    }
+    return canonical;
+}
+
+// Function to append a value's bytes to a cache payload
+template <class T>
+void appendBytes(string &payload, const T &value)
+{
+    payload.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Function to take a value's bytes off the front of a cache payload; returns false if it is too short
+template <class T>
+bool takeBytes(const string &payload, size_t &pos, T &value)
+{
+    if (payload.size() - pos < sizeof(value))
+    {
+        return false;
+    }
+    memcpy(&value, payload.data() + pos, sizeof(value));
+    pos += sizeof(value);
+    return true;
+}
+
+// Function to encode a solution for the solution cache: every ply with the key it was taken from, then
+// the final key, score and bullet mark, then the final layout as written to the output file
+template <class State>
+string encodeCachedPlan(const Dungeon &dungeon, const Solution<State> &solution)
+{
+    string payload;
+    appendBytes(payload, static_cast<uint32_t>(solution.plyActions.size()));
+    for (size_t i = 0; i < solution.plyActions.size(); ++i)
+    {
+        appendBytes(payload, solution.plyActions[i]);
+        appendBytes(payload, solution.plyKeys[i]);
+    }
+    appendBytes(payload, solution.finalState.hashKey);
+    appendBytes(payload, static_cast<int32_t>(solution.finalState.score));
+    appendBytes(payload, solution.bulletMark);
+    for (const auto &row : renderLayout(dungeon, solution.finalState, solution.bulletMark))
+    {
+        payload += row;
+    }
+    return payload;
+}
+
+// Function to rebuild a solution from a cached plan by replaying it through the successor generator
+// Every ply must match a successor's action and key, and the replay must end on the cached score and
+// layout; returns false otherwise, so a stale or foreign record is never written out.
+template <class State>
+bool replayCachedPlan(const Dungeon &dungeon, const State &initialState, const string &payload, Solution<State> &solution)
+{
+    size_t pos = 0;
+    uint32_t plies;
+    if (!takeBytes(payload, pos, plies) || plies > payload.size())
+    {
+        return false;
+    }
+    vector<pair<uint8_t, uint64_t>> steps(plies); // Action and from-key of every ply
+    for (auto &step : steps)
+    {
+        if (!takeBytes(payload, pos, step.first) || !takeBytes(payload, pos, step.second))
+        {
+            return false;
+        }
+    }
+    uint64_t finalKey;
+    int32_t score;
+    int64_t bulletMark;
+    if (!takeBytes(payload, pos, finalKey) || !takeBytes(payload, pos, score) || !takeBytes(payload, pos, bulletMark))
+    {
+        return false;
+    }
+    solution = {initialState, {}};
+    ExpansionCounters counters;
+    State state = initialState;
+    vector<SearchNode<State>> successors;
+    for (uint32_t i = 0; i < plies; ++i)
+    {
+        if (state.hashKey != steps[i].second)
+        {
+            return false;
+        }
+        uint64_t nextKey = i + 1 < plies ? steps[i + 1].second : finalKey;
+        generateSuccessors(dungeon, state, counters, successors);
+        auto next = find_if(successors.begin(), successors.end(), [&](const SearchNode<State> &node)
+                            { return node.action == steps[i].first && node.state.hashKey == nextKey; });
+        if (next == successors.end())
+        {
+            return false;
+        }
+        recordStep(dungeon, solution, state, next->action);
+        state = next->state;
+    }
+    solution.finalState = state;
+    string layout;
+    for (const auto &row : renderLayout(dungeon, state, solution.bulletMark))
+    {
+        layout += row;
+    }
+    return state.hashKey == finalKey && state.score == score && solution.bulletMark == bulletMark &&
+           payload.compare(pos, string::npos, layout) == 0;
+}
+
+// Function to run the search selected on the command line; depth only applies to minimax and expectimax
+// Budgets are only taken by the serial BFS, A* and the adversarial searches; main rejects them for the others
+template <class State>
+Solution<State> solveDungeon(const Dungeon &dungeon, const State &initialState, const string &algo, int depth, int numThreads,
+                      uint64_t memLimit, const string &spillDir, const SearchBudget &limits, SearchStats &stats)
+{
+    SearchBudget budget = limits;
+    budget.start();
+    if (algo == "astar")
+    {
+        return astar(dungeon, initialState, stats, budget);
+    }
+    if (algo == "minimax" || algo == "expectimax")
+    {
+        return adversarialSearch(dungeon, initialState, algo == "expectimax", depth, stats, budget);
+    }
+    if (algo == "idastar")
+    {
+        return idaStar(dungeon, initialState, stats);
+    }
+    if (memLimit > 0)
+    {
+        return externalBfs(dungeon, initialState, memLimit, spillDir, stats);
+    }
+    if (numThreads > 1)
+    {
+        return parallelBfs(dungeon, initialState, numThreads, stats);
+    }
+    return bfs(dungeon, initialState, stats, budget);
+}
+
+// Function to solve a dungeon, answering from the solution cache when it holds a plan that replays
+// Complete fresh solutions are added to the cache; returns true if the solution came from it
+template <class State>
+bool solveWithCache(SolutionCache &cache, const Dungeon &dungeon, const State &initialState, const string &algo,
+                    int depth, int numThreads, uint64_t memLimit, const string &spillDir, const SearchBudget &limits,
+                    SearchStats &stats, Solution<State> &solution)
+{
+    string canonical = canonicalProblem(dungeon, initialState, algo, depth);
+    string payload;
+    if (cache.lookup(canonical, payload))
+    {
+        if (replayCachedPlan(dungeon, initialState, payload, solution))
+        {
+            searchReport() << "Solution cache: hit, " << solution.plyActions.size() << " plies replayed" << endl;
+            return true;
+        }
+        searchReport() << "Solution cache: cached plan does not replay, solving again" << endl;
+    }
+    solution = solveDungeon(dungeon, initialState, algo, depth, numThreads, memLimit, spillDir, limits, stats);
+    if (solution.partial)
+    {
+        return false; // A best-so-far plan depends on the budget, so it is not what the next run should get
+    }
+    if (!cache.store(canonical, encodeCachedPlan(dungeon, solution)))
+    {
+        cerr << "Warning: Failed to add the solution to the cache." << endl;
+    }
+    return false;
+}
+
+// Function to quote a string for JSON output
+string jsonString(const string &text)
+{
+    string quoted = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            quoted += '\\';
+            quoted += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            quoted += escape;
+        }
+        else
+        {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+// Function to list the dungeons of a batch: every regular file of a directory in name order, or the
+// paths in a manifest file, one per line, relative to the manifest's directory ('#' starts a comment line)
+vector<string> listBatchInputs(const string &source)
+{
+    namespace fs = std::filesystem;
+    vector<string> inputs;
+    error_code error;
+    if (fs::is_directory(source, error))
+    {
+        for (const auto &entry : fs::directory_iterator(source, error))
+        {
+            if (entry.is_regular_file())
+            {
+                inputs.push_back(entry.path().string());
+            }
+        }
+        if (error)
+        {
+            cerr << "Error: Failed to list batch directory " << source << "." << endl;
+            exit(EXIT_FAILURE);
+        }
+        sort(inputs.begin(), inputs.end());
+        return inputs;
+    }
+    ifstream manifest(source);
+    if (!manifest.is_open())
+    {
+        cerr << "Error: Failed to open batch manifest " << source << "." << endl;
+        exit(EXIT_FAILURE);
+    }
+    fs::path base = fs::path(source).parent_path();
+    string line;
+    while (getline(manifest, line))
+    {
+        line.erase(0, line.find_first_not_of(" \t"));
+        line.erase(line.find_last_not_of(" \t\r") + 1);
+        if (!line.empty() && line[0] != '#')
+        {
+            inputs.push_back((base / line).string());
+        }
+    }
+    return inputs;
+}
+
+// Structure to hold the outcome of one dungeon of a batch
+struct BatchResult
+{
+    string input;
+    string output;
+    string result; // "win", "loss", "none", or "error" if the dungeon could not be loaded or its plan written
+    string error;
+    size_t planLength = 0;
+    int score = 0;
+    uint64_t nanos = 0;
+    uint64_t nodesExpanded = 0;
+    bool cached = false; // Answered from the solution cache
+    bool partial = false; // Best plan found before the budget ran out
+};
+
+// Function to write the aggregate of a batch as JSON
+void writeBatchSummary(const string &filename, const vector<BatchResult> &results, const string &algo, int numWorkers,
+                       uint64_t totalNanos)
+{
+    ofstream summaryFile(filename);
+    if (!summaryFile.is_open())
+    {
+        cerr << "Error: Failed to open summary file." << endl;
+        exit(EXIT_FAILURE);
+    }
+    map<string, size_t> outcomes = {{"win", 0}, {"loss", 0}, {"none", 0}, {"error", 0}};
+    uint64_t searchNanos = 0, nodesExpanded = 0;
+    size_t cacheHits = 0, partial = 0;
+    for (const auto &result : results)
+    {
+        outcomes[result.result]++;
+        cacheHits += result.cached;
+        partial += result.partial;
+        searchNanos += result.nanos;
+        nodesExpanded += result.nodesExpanded;
+    }
+    summaryFile << "{\n";
+    summaryFile << "  \"algorithm\": " << jsonString(algo) << ",\n";
+    summaryFile << "  \"workers\": " << numWorkers << ",\n";
+    summaryFile << "  \"dungeons\": " << results.size() << ",\n";
+    summaryFile << "  \"wins\": " << outcomes["win"] << ",\n";
+    summaryFile << "  \"losses\": " << outcomes["loss"] << ",\n";
+    summaryFile << "  \"unsolved\": " << outcomes["none"] << ",\n";
+    summaryFile << "  \"errors\": " << outcomes["error"] << ",\n";
+    summaryFile << "  \"cache_hits\": " << cacheHits << ",\n";
+    summaryFile << "  \"budget_exhausted\": " << partial << ",\n";
+    summaryFile << "  \"total_seconds\": " << totalNanos * 1e-9 << ",\n";
+    summaryFile << "  \"search_seconds\": " << searchNanos * 1e-9 << ",\n"; // Summed over workers
+    summaryFile << "  \"nodes_expanded\": " << nodesExpanded << ",\n";
+    summaryFile << "  \"results\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const BatchResult &result = results[i];
+        summaryFile << (i ? ",\n" : "\n") << "    {\"input\": " << jsonString(result.input) << ", \"result\": \"" << result.result << "\"";
+        if (result.result == "error")
+        {
+            summaryFile << ", \"error\": " << jsonString(result.error) << "}";
+            continue;
+        }
+        summaryFile << ", \"output\": " << jsonString(result.output) << ", \"plan_length\": " << result.planLength
+                    << ", \"score\": " << result.score << ", \"seconds\": " << result.nanos * 1e-9
+                    << ", \"nodes_expanded\": " << result.nodesExpanded << ", \"cached\": " << (result.cached ? "true" : "false")
+                    << ", \"budget_exhausted\": " << (result.partial ? "true" : "false") << "}";
+    }
+    summaryFile << (results.empty() ? "]\n" : "\n  ]\n");
+    summaryFile << "}\n";
+    summaryFile.close();
+}
+
+// Function to solve one batch input with the state type chosen for it and fill in its result
+template <class State>
+void solveBatchInput(DungeonFile &file, State &initialState, BatchResult &result, const string &algo, int depth,
+                     bool greedy, const SearchBudget &budget, SolutionCache *cache)
+{
+    Dungeon dungeon;
+    if (!buildDungeon(file, dungeon, initialState, result.error))
+    {
+        result.result = "error";
+        return;
+    }
+    if (greedy)
+    {
+        initGreedyMonsters(dungeon);
+    }
+    SearchStats stats;
+    uint64_t start = nowNanos();
+    Solution<State> solution;
+    if (cache)
+    {
+        result.cached = solveWithCache(*cache, dungeon, initialState, algo, depth, 1, 0, "", budget, stats, solution);
+    }
+    else
+    {
+        solution = solveDungeon(dungeon, initialState, algo, depth, 1, 0, "", budget, stats);
+    }
+    result.nanos = nowNanos() - start;
+    result.result = isWin(solution.finalState) ? "win" : isLoss(solution.finalState) ? "loss" : "none";
+    result.partial = solution.partial;
+    result.planLength = solution.actions.size();
+    result.score = solution.finalState.score;
+    result.nodesExpanded = stats.nodesExpanded;
+    if (!writeOutputToFile(result.output, dungeon, solution, result.error))
+    {
+        result.result = "error";
+    }
+}
+
+// Function to solve every dungeon of a batch on a pool of workers, one serial search per dungeon at a time
+// Each solution is written to the output directory under its input's file name. Workers keep their
+// search memory between dungeons, and a dungeon that fails to load or to write is reported without stopping the batch.
+int runBatch(const string &source, const string &outputDir, const string &algo, int depth, bool greedy, int numWorkers,
+             const SearchBudget &budget, const string &summaryFilename, SolutionCache *cache)
+{
+    namespace fs = std::filesystem;
+    vector<string> inputs = listBatchInputs(source);
+    error_code error;
+    fs::create_directories(outputDir, error);
+    if (error || !fs::is_directory(outputDir))
+    {
+        cerr << "Error: Failed to create output directory " << outputDir << "." << endl;
+        return EXIT_FAILURE;
+    }
+    vector<BatchResult> results(inputs.size());
+    map<string, string> outputs; // Output name -> input that claimed it
+    for (size_t i = 0; i < inputs.size(); ++i)
+    {
+        results[i].input = inputs[i];
+        results[i].output = (fs::path(outputDir) / fs::path(inputs[i]).filename()).string();
+        auto claimed = outputs.emplace(results[i].output, inputs[i]);
+        if (!claimed.second)
+        {
+            cerr << "Error: " << inputs[i] << " and " << claimed.first->second << " would both be written to "
+                 << results[i].output << "." << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    uint64_t batchStart = nowNanos();
+    parallelFor(numWorkers, inputs.size(), [&](size_t i)
+                {
+                    quietSearch = true;
+                    BatchResult &result = results[i];
+                    DungeonFile file;
+                    if (!loadDungeonFile(result.input, file, result.error))
+                    {
+                        result.result = "error";
+                        return;
+                    }
+                    withStateFor(file, [&](auto initialState)
+                                 { solveBatchInput(file, initialState, result, algo, depth, greedy, budget, cache); });
+                });
+    uint64_t totalNanos = nowNanos() - batchStart;
+    size_t failed = 0, wins = 0;
+    for (const auto &result : results)
+    {
+        if (result.result == "error")
+        {
+            cerr << "Error: " << result.input << ": " << result.error << endl;
+            failed++;
+        }
+        wins += result.result == "win";
+    }
+    cerr << "Batch: " << inputs.size() << " dungeons, " << wins << " won, " << failed << " failed, "
+         << totalNanos * 1e-9 << "s on " << numWorkers << " workers" << endl;
+    if (!summaryFilename.empty())
+    {
+        writeBatchSummary(summaryFilename, results, algo, numWorkers, totalNanos);
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+// Largest dungeon a server request may carry, and the longest request line read while looking for one
+const size_t kMaxRequestBytes = 64 << 20;
+const size_t kMaxRequestLine = 4096;
+
+// Bytes asked of the kernel per read while a request arrives
+const size_t kReadChunk = 64 << 10;
+
+// Buffered reader of the requests arriving on one server connection
+// The buffer keeps its capacity, so a connection stops allocating once it has seen its largest request.
+class RequestReader
+{
+public:
+    explicit RequestReader(int fd) : fd(fd) {}
+
+    // Function to read the next line without its newline; returns false at the end of the stream or on
+    // a line longer than kMaxRequestLine
+    bool readLine(string &line)
+    {
+        size_t scanned = 0;
+        while (true)
+        {
+            size_t end = buffer.find('\n', pos + scanned);
+            if (end != string::npos)
+            {
+                line.assign(buffer, pos, end - pos);
+                pos = end + 1;
+                return true;
+            }
+            scanned = buffer.size() - pos;
+            if (scanned > kMaxRequestLine || !fill())
+            {
+                return false;
+            }
+        }
+    }
+
+    // Function to read exactly size bytes; returns false if the stream ends first
+    bool readBytes(size_t size, string &bytes)
+    {
+        while (buffer.size() - pos < size)
+        {
+            if (!fill())
+            {
+                return false;
+            }
+        }
+        bytes.assign(buffer, pos, size);
+        pos += size;
+        return true;
+    }
+
+private:
+    int fd;
+    string buffer;
+    size_t pos = 0; // Start of the bytes not read yet
+
+    // Function to drop the bytes already read and append the next chunk of the stream
+    bool fill()
+    {
+        buffer.erase(0, pos);
+        pos = 0;
+        size_t size = buffer.size();
+        buffer.resize(size + kReadChunk);
+        ssize_t got;
+        do
+        {
+            got = read(fd, &buffer[size], kReadChunk);
+        } while (got < 0 && errno == EINTR);
+        buffer.resize(size + max<ssize_t>(got, 0));
+        return got > 0;
+    }
+};
+
+// Function to write a whole buffer to a descriptor; returns false once the peer has gone
+bool writeAll(int fd, const string &data)
+{
+    for (size_t done = 0; done < data.size();)
+    {
+        ssize_t written = write(fd, data.data() + done, data.size() - done);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        done += written;
+    }
+    return true;
+}
+
+// Options every request of a server is solved with
+struct ServeOptions
+{
+    string algo;
+    int depth = 0;
+    bool greedy = false;
+    SearchBudget budget;
+    SolutionCache *cache = nullptr;
+};
+
+// Function to append a response frame to a buffer: a "<kind> <bytes> [fields]" line, then the bytes
+void appendFrame(string &response, const string &kind, const string &fields, const string &body)
+{
+    response += kind + " " + to_string(body.size());
+    if (!fields.empty())
+    {
+        response += " " + fields;
+    }
+    response += '\n';
+    response += body;
+}
+
+// Function to solve a parsed request dungeon with the state type chosen for it and append the response frame
+template <class State>
+void answerWithState(const ServeOptions &options, DungeonFile &file, Dungeon &dungeon, State &initialState, string &response)
+{
+    string error;
+    if (!buildDungeon(file, dungeon, initialState, error))
+    {
+        appendFrame(response, "ERROR", "", error);
+        return;
+    }
+    if (options.greedy)
+    {
+        initGreedyMonsters(dungeon);
+    }
+    SearchStats stats;
+    Solution<State> solution;
+    if (options.cache)
+    {
+        solveWithCache(*options.cache, dungeon, initialState, options.algo, options.depth, 1, 0, "", options.budget,
+                       stats, solution);
+    }
+    else
+    {
+        solution = solveDungeon(dungeon, initialState, options.algo, options.depth, 1, 0, "", options.budget, stats);
+    }
+    ostringstream output;
+    writeSolution(output, dungeon, solution);
+    string result = isWin(solution.finalState) ? "win" : isLoss(solution.finalState) ? "loss" : "none";
+    appendFrame(response, "RESULT", result + (solution.partial ? " partial" : " full"), output.str());
+}
+
+// Function to solve the dungeon carried by one request and append the response frame
+// The dungeon objects belong to the connection and are refilled for every request, keeping their memory.
+void answerRequest(const string &text, const ServeOptions &options, DungeonFile &file, Dungeon &dungeon, string &response)
+{
+    string error;
+    if (!parseDungeonFile(text.data(), text.size(), file, error))
+    {
+        appendFrame(response, "ERROR", "", "Invalid dungeon: " + error + ".");
+        return;
+    }
+    withStateFor(file, [&](auto initialState)
+                 { answerWithState(options, file, dungeon, initialState, response); });
+}
+
+// Function to answer the requests of one connection until it sends QUIT or closes
+// Requests are "SOLVE <bytes>" lines followed by that many bytes of dungeon in the input file format.
+// Each is answered in order by a "RESULT <bytes> <win|loss|none> <full|partial>" line followed by the
+// output file, or "ERROR <bytes>" and a message. A malformed request line cannot be skipped, so it is
+// answered with an error and the connection is closed.
+void serveConnection(int inFd, int outFd, const ServeOptions &options)
+{
+    quietSearch = true; // Searches run back to back on this thread and keep their memory between requests
+    RequestReader reader(inFd);
+    DungeonFile file;
+    Dungeon dungeon;
+    string line, text, response;
+    while (reader.readLine(line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+        if (line == "QUIT")
+        {
+            break;
+        }
+        response.clear();
+        char *end = nullptr;
+        unsigned long long size = line.compare(0, 6, "SOLVE ") == 0 ? strtoull(line.c_str() + 6, &end, 10) : 0;
+        if (!end || end == line.c_str() + 6 || *end != '\0' || size > kMaxRequestBytes)
+        {
+            appendFrame(response, "ERROR", "", "Malformed request; expected SOLVE <bytes> of at most " +
+                                                   to_string(kMaxRequestBytes) + " bytes.");
+            writeAll(outFd, response);
+            break;
+        }
+        if (!reader.readBytes(size, text))
+        {
+            break;
+        }
+        answerRequest(text, options, file, dungeon, response);
+        if (!writeAll(outFd, response))
+        {
+            break;
+        }
+    }
+}
+
+// Function to run the solver as a resident server, on stdin and stdout or on a Unix socket
+// A fixed pool of numWorkers threads takes socket connections one at a time, so the threads and their
+// search pools and tables are made once; further clients wait in accept until a worker is free.
+// Clients that keep a connection open pay no startup or warm-up per solve.
+int runServer(const string &socketPath, const ServeOptions &options, int numWorkers)
+{
+    signal(SIGPIPE, SIG_IGN); // A client that hangs up ends its connection, not the server
+    if (socketPath.empty())
+    {
+        serveConnection(STDIN_FILENO, STDOUT_FILENO, options);
+        return EXIT_SUCCESS;
+    }
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(address.sun_path))
+    {
+        cerr << "Error: Socket path " << socketPath << " is too long." << endl;
+        return EXIT_FAILURE;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+    struct stat info;
+    if (lstat(socketPath.c_str(), &info) == 0 && S_ISSOCK(info.st_mode))
+    {
+        // Replace a socket left behind by an earlier server, but not one a running server answers on
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool live = probe >= 0 && connect(probe, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        if (probe >= 0)
+        {
+            close(probe);
+        }
+        if (live)
+        {
+            cerr << "Error: A server is already listening on " << socketPath << "." << endl;
+            return EXIT_FAILURE;
+        }
+        unlink(socketPath.c_str());
+    }
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0)
+    {
+        cerr << "Error: Failed to listen on " << socketPath << ": " << strerror(errno) << "." << endl;
+        return EXIT_FAILURE;
+    }
+    cerr << "Serving on " << socketPath << " with " << numWorkers << " workers" << endl;
+    atomic<bool> failed(false);
+    auto worker = [&]()
+    {
+        while (!failed)
+        {
+            int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+            if (connection < 0)
+            {
+                if (errno == EINTR || errno == ECONNABORTED)
+                    continue;
+                if (!failed.exchange(true))
+                {
+                    cerr << "Error: Failed to accept a connection: " << strerror(errno) << "." << endl;
+                    shutdown(listener, SHUT_RDWR); // Wakes the workers still waiting in accept
+                }
+                return;
+            }
+            serveConnection(connection, connection, options);
+            close(connection);
+        }
+    };
+    vector<thread> workers;
+    for (int i = 1; i < numWorkers; ++i)
+    {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (thread &t : workers)
+    {
+        t.join();
+    }
+    close(listener);
+    return EXIT_FAILURE;
+}
 
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    vector<string> files;
+    string algo = "bfs";
+    int numThreads = 1;
+    uint64_t memLimit = 0; // Nonzero selects the external-memory BFS
+    string spillDir = ".";
+    string statsFilename;
+    string monsters = "any";
+    string batchSource;
+    string summaryFilename;
+    string cacheDir;
+    bool serve = false;
+    string socketPath; // Empty: serve on stdin and stdout
+    int depth = 0; // Plies for minimax and expectimax; 0 until --depth or the default sets it
+    SearchBudget budget;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 7, "--algo=") == 0)
+        {
+            algo = arg.substr(7);
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            numThreads = max(1, atoi(arg.c_str() + 10));
+        }
+        else if (arg.compare(0, 12, "--mem-limit=") == 0)
+        {
+            memLimit = parseByteSize(arg.substr(12));
+            if (memLimit == 0)
+            {
+                cerr << "Error: Invalid memory limit " << arg.substr(12) << "." << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg.compare(0, 12, "--spill-dir=") == 0)
+        {
+            spillDir = arg.substr(12);
+        }
+        else if (arg.compare(0, 8, "--batch=") == 0)
+        {
+            batchSource = arg.substr(8);
+        }
+        else if (arg.compare(0, 13, "--time-limit=") == 0)
+        {
+            char *end;
+            double millis = strtod(arg.c_str() + 13, &end);
+            if (end == arg.c_str() + 13 || *end != '\0' || !(millis > 0) || millis > 1e12)
+            {
+                cerr << "Error: Invalid time limit " << arg.substr(13) << "; expected milliseconds." << endl;
+                return EXIT_FAILURE;
+            }
+            budget.timeLimitNanos = max<uint64_t>(1, millis * 1e6);
+        }
+        else if (arg.compare(0, 13, "--node-limit=") == 0)
+        {
+            budget.nodeLimit = strtoull(arg.c_str() + 13, nullptr, 10);
+            if (budget.nodeLimit == 0)
+            {
+                cerr << "Error: Invalid node limit " << arg.substr(13) << "." << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg.compare(0, 8, "--depth=") == 0)
+        {
+            depth = atoi(arg.c_str() + 8);
+            if (depth < 1 || depth > kMaxSearchDepth)
+            {
+                cerr << "Error: Invalid search depth " << arg.substr(8) << "; expected 1 to " << kMaxSearchDepth << " plies." << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg == "--serve" || arg.compare(0, 8, "--serve=") == 0)
+        {
+            serve = true;
+            socketPath = arg.size() > 8 ? arg.substr(8) : "";
+        }
+        else if (arg.compare(0, 8, "--cache=") == 0)
+        {
+            cacheDir = arg.substr(8);
+        }
+        else if (arg.compare(0, 10, "--summary=") == 0)
+        {
+            summaryFilename = arg.substr(10);
+        }
+        else if (arg.compare(0, 11, "--monsters=") == 0)
+        {
+            monsters = arg.substr(11);
+        }
+        else if (arg.compare(0, 8, "--stats=") == 0)
+        {
+#ifdef NO_SEARCH_STATS
+            cerr << "Error: --stats needs a build without -DNO_SEARCH_STATS." << endl;
+            return EXIT_FAILURE;
+#endif
+            statsFilename = arg.substr(8);
+        }
+        else
+        {
+            files.push_back(arg);
+        }
+    }
+    bool adversarial = algo == "minimax" || algo == "expectimax";
+    if (files.size() != (serve ? 0 : batchSource.empty() ? 2 : 1) ||
+        (algo != "bfs" && algo != "astar" && algo != "idastar" && !adversarial) ||
+        (monsters != "any" && monsters != "greedy") || (batchSource.empty() && !summaryFilename.empty()) ||
+        (depth != 0 && !adversarial))
+    {
+        cerr << "Usage: " << argv[0] << " <input_file> <output_file> [--algo=bfs|astar|idastar|minimax|expectimax] [--depth=PLIES]"
+             << " [--monsters=any|greedy] [--threads=N] [--mem-limit=SIZE [--spill-dir=DIR]] [--time-limit=MS] [--node-limit=N]"
+             << " [--stats=file.json] [--cache=DIR]" << endl;
+        cerr << "       " << argv[0] << " --batch=<input_dir|manifest> <output_dir> [--algo=bfs|astar|idastar|minimax|expectimax]"
+             << " [--depth=PLIES] [--monsters=any|greedy] [--threads=N] [--time-limit=MS] [--node-limit=N] [--summary=file.json]"
+             << " [--cache=DIR]" << endl;
+        cerr << "       " << argv[0] << " --serve[=SOCKET] [--algo=bfs|astar|idastar|minimax|expectimax] [--depth=PLIES]"
+             << " [--monsters=any|greedy] [--threads=N] [--time-limit=MS] [--node-limit=N] [--cache=DIR]" << endl;
+        cerr << "bfs returns a shortest win; astar and idastar return a best-scoring win, the shortest among those." << endl;
+        return EXIT_FAILURE;
+    }
+    if (adversarial && depth == 0)
+    {
+        depth = algo == "minimax" ? kDefaultMinimaxDepth : kDefaultExpectimaxDepth;
+    }
+    if (budget.limited() && (algo == "idastar" || memLimit > 0 || (numThreads > 1 && batchSource.empty() && !serve)))
+    {
+        cerr << "Error: --time-limit and --node-limit need a single-threaded BFS, A*, minimax or expectimax." << endl;
+        return EXIT_FAILURE;
+    }
+    SolutionCache cache;
+    string error;
+    if (!cacheDir.empty() && !cache.open(cacheDir, error))
+    {
+        cerr << "Error: " << error << endl;
+        return EXIT_FAILURE;
+    }
+    if (serve)
+    {
+        if (!batchSource.empty() || memLimit > 0 || !statsFilename.empty())
+        {
+            cerr << "Error: --serve cannot be combined with --batch, --mem-limit or --stats." << endl;
+            return EXIT_FAILURE;
+        }
+        ServeOptions options;
+        options.algo = algo;
+        options.depth = depth;
+        options.greedy = monsters == "greedy";
+        options.budget = budget;
+        options.cache = cacheDir.empty() ? nullptr : &cache;
+        return runServer(socketPath, options, numThreads); // Threads are connection workers
+    }
+    if (!batchSource.empty())
+    {
+        if (memLimit > 0 || !statsFilename.empty())
+        {
+            cerr << "Error: --batch cannot be combined with --mem-limit or --stats; see --summary." << endl;
+            return EXIT_FAILURE;
+        }
+        return runBatch(batchSource, files[0], algo, depth, monsters == "greedy", numThreads, budget, // Threads are workers
+                        summaryFilename, cacheDir.empty() ? nullptr : &cache);
+    }
+    if (memLimit > 0 && (algo != "bfs" || numThreads > 1))
     {
-        cerr << "Usage: " << argv[0] << " <input_file> <output_file>" << endl;
+        cerr << "Error: --mem-limit runs a single-threaded BFS and cannot be combined with --algo or --threads." << endl;
         return EXIT_FAILURE;
     }
-    State initialState = readInputFromFile(argv[1]);
-    State finalState = bfs(initialState);
-    writeOutputToFile(argv[2], finalState);
-    return EXIT_SUCCESS;
+    DungeonFile file;
+    readInputFromFile(files[0], file);
+    return withStateFor(file, [&](auto initialState)
+                        {
+                            typedef decltype(initialState) State;
+                            Dungeon dungeon;
+                            if (!buildDungeon(file, dungeon, initialState, error))
+                            {
+                                cerr << "Error: " << error << endl;
+                                return EXIT_FAILURE;
+                            }
+                            if (monsters == "greedy")
+                            {
+                                initGreedyMonsters(dungeon);
+                            }
+                            SearchStats stats;
+                            stats.algorithm = memLimit > 0 ? "external-bfs" : algo == "bfs" && numThreads > 1 ? "parallel-bfs" : algo;
+                            SEARCH_STAT(uint64_t searchStart = nowNanos());
+                            Solution<State> solution;
+                            if (cacheDir.empty())
+                            {
+                                solution = solveDungeon(dungeon, initialState, algo, depth, numThreads, memLimit, spillDir, budget, stats);
+                            }
+                            else if (solveWithCache(cache, dungeon, initialState, algo, depth, numThreads, memLimit, spillDir, budget, stats, solution))
+                            {
+                                stats.algorithm = "cache";
+                            }
+                            SEARCH_STAT(stats.totalNanos = nowNanos() - searchStart);
+                            if (!statsFilename.empty())
+                            {
+                                writeStatsFile(statsFilename, stats, solution, numThreads);
+                            }
+                            if (!writeOutputToFile(files[1], dungeon, solution, error))
+                            {
+                                cerr << "Error: " << error << endl;
+                                return EXIT_FAILURE;
+                            }
+                            return EXIT_SUCCESS; });
 }
@@ -0,0 +1,250 @@
+# Benchmark suite for the Act-Man solver (1.cpp) and simulator (hw1.cpp)
+#   python3 benchmark.py run [--output results.json]   build both programs, time the fixed cases, print JSON
+#   python3 benchmark.py generate ROWS COLS [--walls P] [--monsters N] [--seed S]   print one dungeon
+# Dungeons and simulator seeds are fixed, so result files from different commits can be compared directly.
+import argparse
+import json
+import os
+import random
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+# Fixed benchmark cases; seeds never change so results stay comparable across commits
+# Each case is (name, rows, cols, wall density, monsters, seed)
+DUNGEONS = [
+    ("small", 10, 10, 0.15, 2, 1),
+    ("medium", 12, 12, 0.15, 2, 2),
+    ("wide", 10, 20, 0.20, 3, 5),
+    ("tight", 14, 14, 0.15, 3, 4),
+    ("open", 12, 12, 0.10, 3, 8),
+    ("large", 40, 60, 0.20, 6, 5),
+]
+
+# Solver runs: (dungeon name, extra solver arguments)
+SOLVER_RUNS = [
+    ("small", ["--algo=bfs"]),
+    ("small", ["--algo=astar"]),
+    ("medium", ["--algo=bfs"]),
+    ("medium", ["--algo=bfs", "--threads=4"]),
+    ("medium", ["--algo=astar"]),
+    ("medium", ["--algo=idastar"]),
+    ("wide", ["--algo=bfs"]),
+    ("tight", ["--algo=bfs"]),
+    ("tight", ["--algo=bfs", "--threads=4"]),
+    ("tight", ["--algo=bfs", "--mem-limit=16M"]),
+    ("open", ["--algo=astar"]),
+    ("open", ["--algo=astar", "--monsters=greedy"]),
+    ("large", ["--algo=astar", "--monsters=greedy"]),
+    ("small", ["--algo=minimax", "--depth=8"]),
+    ("tight", ["--algo=minimax", "--depth=8"]),
+    ("small", ["--algo=expectimax", "--depth=6"]),
+]
+
+# Simulator runs: (dungeon name, games)
+SIMULATOR_RUNS = [
+    ("small", 20000),
+    ("tight", 20000),
+    ("large", 5000),
+]
+
+SIMULATOR_SEED = 12345
+
+
+# Function to generate a dungeon in the "rows cols" + grid format read by hw1.cpp and 1.cpp
+# The border is walled, inner cells become walls with the given probability, and Act-Man and the
+# monsters are placed on free cells connected to each other.
+def generate_dungeon(rows, cols, wall_density, monsters, seed):
+    rng = random.Random(seed)
+    grid = [['#' if r in (0, rows - 1) or c in (0, cols - 1) or rng.random() < wall_density else ' '
+             for c in range(cols)] for r in range(rows)]
+    free = [(r, c) for r in range(rows) for c in range(cols) if grid[r][c] == ' ']
+    if len(free) <= monsters:
+        raise ValueError("dungeon is too small for %d monsters" % monsters)
+    start = rng.choice(free)
+    # Flood-fill with king moves from Act-Man so every monster can reach him
+    reachable = {start}
+    stack = [start]
+    while stack:
+        r, c = stack.pop()
+        for dr in (-1, 0, 1):
+            for dc in (-1, 0, 1):
+                cell = (r + dr, c + dc)
+                if 0 <= cell[0] < rows and 0 <= cell[1] < cols and grid[cell[0]][cell[1]] == ' ' \
+                        and cell not in reachable:
+                    reachable.add(cell)
+                    stack.append(cell)
+    cells = sorted(reachable - {start})
+    if len(cells) < monsters:
+        raise ValueError("seed %d leaves too few cells reachable from Act-Man" % seed)
+    rng.shuffle(cells)
+    grid[start[0]][start[1]] = 'A'
+    for i in range(monsters):
+        r, c = cells[i]
+        grid[r][c] = 'DG'[i % 2]
+    return "%d %d\n" % (rows, cols) + "".join("".join(row) + "\n" for row in grid)
+
+
+# Function to compile one of the programs with the flags the benchmark numbers are quoted for
+def build(source, binary):
+    command = ["g++", "-std=c++17", "-O2", "-pthread", "-o", binary, source]
+    print("Building " + " ".join(command), file=sys.stderr)
+    subprocess.check_call(command)
+
+
+# Function to run a command and measure its wall time and peak resident memory
+# The child is reaped with wait4 so its own rusage, not the total of every child so far, gives the peak.
+# Linux carries the peak of the forking interpreter across exec, so small runs report that floor instead.
+def measure(command, timeout, cwd=None):
+    with tempfile.TemporaryFile() as stderr:
+        start = time.perf_counter()
+        process = subprocess.Popen(command, stdout=subprocess.DEVNULL, stderr=stderr, cwd=cwd)
+        while True:
+            pid, status, usage = os.wait4(process.pid, os.WNOHANG)
+            if pid != 0:
+                break
+            if time.perf_counter() - start > timeout:
+                process.kill()
+                os.wait4(process.pid, 0)
+                process.returncode = -9
+                return {"status": "timeout", "seconds": timeout}
+            time.sleep(0.002)
+        seconds = time.perf_counter() - start
+        process.returncode = os.waitstatus_to_exitcode(status)
+        stderr.seek(0)
+        text = stderr.read().decode(errors="replace")
+    return {"status": "ok" if process.returncode == 0 else "failed (exit %d)" % process.returncode,
+            "seconds": round(seconds, 4), "peak_rss_kb": usage.ru_maxrss, "stderr": text}
+
+
+# Function to read the number of nodes a search expanded from the solver's --stats file
+def nodes_expanded(stats_path):
+    try:
+        with open(stats_path) as stats:
+            return json.load(stats).get("nodes_expanded") or None  # Zero in builds without search counters
+    except (OSError, ValueError):
+        return None
+
+
+# Function to run the solver cases
+def run_solver(solver, paths, timeout):
+    results = []
+    with tempfile.TemporaryDirectory() as scratch:
+        for name, arguments in SOLVER_RUNS:
+            output = os.path.join(scratch, "solution.txt")
+            stats = os.path.join(scratch, "stats.json")
+            if os.path.exists(stats):
+                os.remove(stats)  # A run that fails to write its own must not report the previous one's
+            command = [solver, paths[name], output, "--stats=" + stats] + arguments
+            result = measure(command, timeout, cwd=scratch)  # Spill files land here
+            entry = {"dungeon": name, "arguments": arguments, "status": result["status"],
+                     "seconds": result["seconds"], "peak_rss_kb": result.get("peak_rss_kb")}
+            if result["status"] == "ok":
+                nodes = nodes_expanded(stats)
+                with open(output) as solution:
+                    lines = solution.read().splitlines()
+                score = next(line for line in lines if line.startswith("Score: "))
+                entry["plan_length"] = lines.index(score)
+                entry["score"] = int(score.split()[1])
+                entry["nodes_expanded"] = nodes
+                entry["nodes_per_second"] = round(nodes / result["seconds"]) if nodes else None
+            results.append(entry)
+            print("solver %-8s %-28s %s %.3fs" % (name, " ".join(arguments), entry["status"], entry["seconds"]),
+                  file=sys.stderr)
+    return results
+
+
+# Function to run the simulator cases in batch mode with a fixed seed
+def run_simulator(simulator, paths, threads, timeout):
+    results = []
+    with tempfile.TemporaryDirectory() as scratch:
+        for name, games in SIMULATOR_RUNS:
+            output = os.path.join(scratch, "stats.txt")
+            arguments = ["--games=%d" % games, "--threads=%d" % threads, "--seed=%d" % SIMULATOR_SEED]
+            result = measure([simulator, paths[name], output] + arguments, timeout)
+            entry = {"dungeon": name, "arguments": arguments, "status": result["status"],
+                     "seconds": result["seconds"], "peak_rss_kb": result.get("peak_rss_kb")}
+            if result["status"] == "ok":
+                with open(output) as stats:
+                    text = stats.read()
+                mean_turns = float(re.search(r"Mean turns: ([\d.]+)", text).group(1))
+                entry["turns"] = round(mean_turns * games)
+                entry["turns_per_second"] = round(mean_turns * games / result["seconds"])
+                entry["wins"] = int(re.search(r"Wins: (\d+)", text).group(1))
+            results.append(entry)
+            print("simulator %-8s %-34s %s %.3fs" % (name, " ".join(arguments), entry["status"], entry["seconds"]),
+                  file=sys.stderr)
+    return results
+
+
+# Function to write every benchmark dungeon into a directory and return their paths by name
+def write_dungeons(directory):
+    paths = {}
+    for name, rows, cols, density, monsters, seed in DUNGEONS:
+        paths[name] = os.path.join(directory, name + ".txt")
+        with open(paths[name], "w") as dungeon:
+            dungeon.write(generate_dungeon(rows, cols, density, monsters, seed))
+    return paths
+
+
+# Function to get the commit the benchmark ran against, if the tree is a git checkout
+def current_commit(root):
+    try:
+        return subprocess.check_output(["git", "-C", root, "rev-parse", "HEAD"], stderr=subprocess.DEVNULL,
+                                       text=True).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return None
+
+
+def main():
+    root = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description="Benchmark the Act-Man solver (1.cpp) and simulator (hw1.cpp).")
+    commands = parser.add_subparsers(dest="command", required=True)
+    generate = commands.add_parser("generate", help="print one generated dungeon")
+    generate.add_argument("rows", type=int)
+    generate.add_argument("cols", type=int)
+    generate.add_argument("--walls", type=float, default=0.15, help="probability that an inner cell is a wall")
+    generate.add_argument("--monsters", type=int, default=2)
+    generate.add_argument("--seed", type=int, default=1)
+    run = commands.add_parser("run", help="run the benchmark cases and print JSON results")
+    run.add_argument("--solver", help="solver binary to time (default: build 1.cpp)")
+    run.add_argument("--simulator", help="simulator binary to time (default: build hw1.cpp)")
+    run.add_argument("--threads", type=int, default=4, help="threads for simulator batch runs")
+    run.add_argument("--timeout", type=float, default=300, help="seconds before a case is reported as a timeout")
+    run.add_argument("--output", help="write the JSON results here instead of stdout")
+    run.add_argument("--keep-dungeons", help="also write the generated dungeons to this directory")
+    args = parser.parse_args()
+
+    if args.command == "generate":
+        sys.stdout.write(generate_dungeon(args.rows, args.cols, args.walls, args.monsters, args.seed))
+        return
+    with tempfile.TemporaryDirectory() as directory:
+        if args.solver is None:
+            args.solver = os.path.join(directory, "solver")
+            build(os.path.join(root, "1.cpp"), args.solver)
+        if args.simulator is None:
+            args.simulator = os.path.join(directory, "simulator")
+            build(os.path.join(root, "hw1.cpp"), args.simulator)
+        if args.keep_dungeons:
+            os.makedirs(args.keep_dungeons, exist_ok=True)
+            directory = args.keep_dungeons
+        paths = write_dungeons(directory)
+        results = {
+            "commit": current_commit(root),
+            "rss_floor_kb": measure(["true"], args.timeout)["peak_rss_kb"],  # Peaks at this value mean "at most"
+            "dungeons": [dict(zip(("name", "rows", "cols", "walls", "monsters", "seed"), case)) for case in DUNGEONS],
+            "solver": run_solver(args.solver, paths, args.timeout),
+            "simulator": run_simulator(args.simulator, paths, args.threads, args.timeout),
+        }
+    text = json.dumps(results, indent=2) + "\n"
+    if args.output:
+        with open(args.output, "w") as output:
+            output.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
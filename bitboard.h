@@ -0,0 +1,350 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <algorithm>
+#include <cstdint>
+
+// Bitboards for small dungeons, shared by the simulator (hw1.cpp) and the solver (1.cpp)
+// Cells are numbered row-major and held one bit each in up to kMaxBoardWords 64-bit words. A king-move
+// step of a whole frontier is then a handful of shifts and masks per word instead of eight bounds-checked
+// lookups per cell, and a monster's moves (kept in a per-cell table) or a bullet's path are one mask each.
+// Dungeons with more than kMaxBoardCells cells get no board and keep their cell-by-cell move generation
+// and breadth-first search.
+const int kMaxBoardWords = 4;
+const int kMaxBoardCells = 64 * kMaxBoardWords;
+
+// Set of cells on a board of Words 64-bit words
+template <int Words>
+struct Bitboard
+{
+    uint64_t words[Words];
+
+    // Function to get the set holding one cell
+    static Bitboard single(int cell)
+    {
+        Bitboard board = {};
+        board.words[cell >> 6] = uint64_t(1) << (cell & 63);
+        return board;
+    }
+
+    // Function to get the set of cells lo to hi inclusive (empty if hi < lo)
+    static Bitboard range(int lo, int hi)
+    {
+        Bitboard board = {};
+        for (int i = 0; i < Words; ++i)
+        {
+            int first = std::max(lo, i * 64), last = std::min(hi, i * 64 + 63);
+            if (first <= last)
+                board.words[i] = (~uint64_t(0) >> (63 - (last - first))) << (first - i * 64);
+        }
+        return board;
+    }
+
+    // Function to load a set from an array of at least Words words
+    static Bitboard load(const uint64_t *source)
+    {
+        Bitboard board = {};
+        std::copy(source, source + Words, board.words);
+        return board;
+    }
+
+    bool any() const
+    {
+        uint64_t bits = 0;
+        for (int i = 0; i < Words; ++i)
+            bits |= words[i];
+        return bits != 0;
+    }
+
+    bool test(int cell) const
+    {
+        return (words[cell >> 6] >> (cell & 63)) & 1;
+    }
+
+    void set(int cell)
+    {
+        words[cell >> 6] |= uint64_t(1) << (cell & 63);
+    }
+
+    void reset(int cell)
+    {
+        words[cell >> 6] &= ~(uint64_t(1) << (cell & 63));
+    }
+
+    // Function to get the lowest cell in the set, or -1 if it is empty
+    int lowest() const
+    {
+        for (int i = 0; i < Words; ++i)
+        {
+            if (words[i])
+                return i * 64 + __builtin_ctzll(words[i]);
+        }
+        return -1;
+    }
+
+    // Function to get the highest cell in the set, or -1 if it is empty
+    int highest() const
+    {
+        for (int i = Words - 1; i >= 0; --i)
+        {
+            if (words[i])
+                return i * 64 + 63 - __builtin_clzll(words[i]);
+        }
+        return -1;
+    }
+
+    // Function to move every cell `shift` indices up (towards higher cells)
+    Bitboard up(int shift) const
+    {
+        Bitboard board = {};
+        int wordShift = shift >> 6, bitShift = shift & 63;
+        for (int i = Words - 1; i >= wordShift; --i)
+        {
+            board.words[i] = words[i - wordShift] << bitShift;
+            if (bitShift && i - wordShift > 0)
+                board.words[i] |= words[i - wordShift - 1] >> (64 - bitShift);
+        }
+        return board;
+    }
+
+    // Function to move every cell `shift` indices down (towards lower cells)
+    Bitboard down(int shift) const
+    {
+        Bitboard board = {};
+        int wordShift = shift >> 6, bitShift = shift & 63;
+        for (int i = 0; i + wordShift < Words; ++i)
+        {
+            board.words[i] = words[i + wordShift] >> bitShift;
+            if (bitShift && i + wordShift + 1 < Words)
+                board.words[i] |= words[i + wordShift + 1] << (64 - bitShift);
+        }
+        return board;
+    }
+
+    Bitboard operator|(const Bitboard &other) const
+    {
+        Bitboard board;
+        for (int i = 0; i < Words; ++i)
+            board.words[i] = words[i] | other.words[i];
+        return board;
+    }
+
+    Bitboard operator&(const Bitboard &other) const
+    {
+        Bitboard board;
+        for (int i = 0; i < Words; ++i)
+            board.words[i] = words[i] & other.words[i];
+        return board;
+    }
+
+    Bitboard operator~() const
+    {
+        Bitboard board;
+        for (int i = 0; i < Words; ++i)
+            board.words[i] = ~words[i];
+        return board;
+    }
+
+    // Function to call visit(cell) for every cell in the set, in increasing order
+    template <class Visit>
+    void forEach(Visit visit) const
+    {
+        for (int i = 0; i < Words; ++i)
+        {
+            for (uint64_t bits = words[i]; bits; bits &= bits - 1)
+                visit(i * 64 + __builtin_ctzll(bits));
+        }
+    }
+};
+
+// Static masks of a dungeon small enough for a bitboard
+struct SmallBoard
+{
+    int numRows = 0;
+    int numCols = 0;
+    int words = 0;                       // Words per board, or 0 if the dungeon is too big for one
+    uint64_t floor[kMaxBoardWords];      // Cells that are not walls
+    uint64_t notFirstCol[kMaxBoardWords]; // Cells a step east may land on (a step into column 0 wrapped a row)
+    uint64_t notLastCol[kMaxBoardWords];  // Cells a step west may land on
+};
+
+// Function to build the board of a dungeon; isWall(row, col) reports its static walls
+template <class IsWall>
+SmallBoard buildSmallBoard(int numRows, int numCols, IsWall isWall)
+{
+    SmallBoard board;
+    board.numRows = numRows;
+    board.numCols = numCols;
+    std::fill(board.floor, board.floor + kMaxBoardWords, 0);
+    std::fill(board.notFirstCol, board.notFirstCol + kMaxBoardWords, 0);
+    std::fill(board.notLastCol, board.notLastCol + kMaxBoardWords, 0);
+    long long numCells = static_cast<long long>(numRows) * numCols;
+    if (numCells > kMaxBoardCells)
+        return board;
+    board.words = (numCells + 63) / 64;
+    for (int row = 0; row < numRows; ++row)
+    {
+        for (int col = 0; col < numCols; ++col)
+        {
+            int cell = row * numCols + col;
+            uint64_t bit = uint64_t(1) << (cell & 63);
+            if (!isWall(row, col))
+                board.floor[cell >> 6] |= bit;
+            if (col != 0)
+                board.notFirstCol[cell >> 6] |= bit;
+            if (col != numCols - 1)
+                board.notLastCol[cell >> 6] |= bit;
+        }
+    }
+    return board;
+}
+
+// A board's masks loaded as Words-word sets, with the steps Act-Man, monsters and bullets take on them
+// Directions are indexed North, South, East, West, as in wall_runs.h.
+template <int Words>
+struct BoardMasks
+{
+    typedef Bitboard<Words> Board;
+
+    int numCols;
+    Board floor;
+    Board notFirstCol;
+    Board notLastCol;
+
+    explicit BoardMasks(const SmallBoard &board)
+        : numCols(board.numCols), floor(Board::load(board.floor)),
+          notFirstCol(Board::load(board.notFirstCol)), notLastCol(Board::load(board.notLastCol))
+    {
+    }
+
+    // Function to move every cell of a set one step in a direction, dropping steps off the board
+    // Walls are not masked out
+    Board step(const Board &cells, int direction) const
+    {
+        switch (direction)
+        {
+        case 0:
+            return cells.down(numCols);
+        case 1:
+            return cells.up(numCols);
+        case 2:
+            return cells.up(1) & notFirstCol;
+        default:
+            return cells.down(1) & notLastCol;
+        }
+    }
+
+    // Function to get every cell within one king step of a set, the set itself included; walls are not masked out
+    Board kingStep(const Board &cells) const
+    {
+        // Spread sideways within each row, then the widened rows up and down
+        Board rows = cells | (cells.up(1) & notFirstCol) | (cells.down(1) & notLastCol);
+        return rows | rows.up(numCols) | rows.down(numCols);
+    }
+
+    // Function to get the first `reach` cells from cell in a direction, the path of a bullet that reaches that far
+    Board ray(int cell, int direction, int reach) const
+    {
+        switch (direction)
+        {
+        case 0:
+        case 1:
+        {
+            // Column 0 shifted over to the cell's column; the complement's bits past the last cell shift
+            // further out and never meet a range inside the board
+            Board column = (~notFirstCol).up(cell % numCols);
+            return (direction == 0 ? Board::range(cell - reach * numCols, cell - 1)
+                                   : Board::range(cell + 1, cell + reach * numCols)) &
+                   column;
+        }
+        case 2:
+            return Board::range(cell + 1, cell + reach);
+        default:
+            return Board::range(cell - reach, cell - 1);
+        }
+    }
+};
+
+// Function to fill distance with the king-move distance from source along the floor, one frontier at a time
+template <int Words, class Distance>
+void boardKingDistances(const SmallBoard &board, int source, Distance *distance, Distance unreachable)
+{
+    typedef Bitboard<Words> Board;
+    const Board floor = Board::load(board.floor);
+    const Board notFirstCol = Board::load(board.notFirstCol);
+    const Board notLastCol = Board::load(board.notLastCol);
+    std::fill(distance, distance + board.numRows * board.numCols, unreachable);
+    Board frontier = Board::single(source);
+    Board reached = frontier;
+    for (Distance steps = 0; frontier.any(); ++steps)
+    {
+        frontier.forEach([&](int cell)
+                         { distance[cell] = steps; });
+        // Spread sideways within each row, then the widened rows up and down
+        Board rows = frontier | (frontier.up(1) & notFirstCol) | (frontier.down(1) & notLastCol);
+        Board next = rows | rows.up(board.numCols) | rows.down(board.numCols);
+        frontier = next & floor & ~reached;
+        reached = reached | frontier;
+    }
+}
+
+// Function to compute king-move distances on the dungeon's board; returns false if it has none
+template <class Distance>
+bool kingDistancesOnBoard(const SmallBoard &board, int source, Distance *distance, Distance unreachable)
+{
+    switch (board.words)
+    {
+    case 1:
+        boardKingDistances<1>(board, source, distance, unreachable);
+        return true;
+    case 2:
+        boardKingDistances<2>(board, source, distance, unreachable);
+        return true;
+    case 3:
+        boardKingDistances<3>(board, source, distance, unreachable);
+        return true;
+    case 4:
+        boardKingDistances<4>(board, source, distance, unreachable);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Function to store, for every cell, the floor cells one king step from it as Words words at neighbours[cell * Words]
+template <int Words>
+void boardKingNeighbours(const SmallBoard &board, uint64_t *neighbours)
+{
+    typedef Bitboard<Words> Board;
+    const BoardMasks<Words> masks(board);
+    for (int cell = 0; cell < board.numRows * board.numCols; ++cell)
+    {
+        Board single = Board::single(cell);
+        Board next = masks.kingStep(single) & masks.floor & ~single;
+        std::copy(next.words, next.words + Words, neighbours + cell * Words);
+    }
+}
+
+// Function to fill the king-step table of the dungeon's board (numRows * numCols * words words); returns false if it has none
+inline bool kingNeighboursOnBoard(const SmallBoard &board, uint64_t *neighbours)
+{
+    switch (board.words)
+    {
+    case 1:
+        boardKingNeighbours<1>(board, neighbours);
+        return true;
+    case 2:
+        boardKingNeighbours<2>(board, neighbours);
+        return true;
+    case 3:
+        boardKingNeighbours<3>(board, neighbours);
+        return true;
+    case 4:
+        boardKingNeighbours<4>(board, neighbours);
+        return true;
+    default:
+        return false;
+    }
+}
+
+#endif
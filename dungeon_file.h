@@ -0,0 +1,137 @@
+#ifndef DUNGEON_FILE_H
+#define DUNGEON_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Dungeon map as read from an input file: a "rows cols" header line followed by one line per row
+// Shared by the simulator (hw1.cpp) and the solver (1.cpp).
+struct DungeonFile
+{
+    int numRows = 0;
+    int numCols = 0;
+    std::vector<char> grid;                         // Row-major cells as in the file; short rows padded with ' '
+    int64_t actManCell = -1;                        // Row-major cell of 'A'
+    std::vector<std::pair<int64_t, char>> monsters; // Row-major cell and type ('D' or 'G') of every monster, in file order
+};
+
+// Function to parse a dungeon held in memory; returns false and sets error if it is malformed
+// Cells are copied straight into the flat grid and classified in the same pass.
+inline bool parseDungeonFile(const char *data, std::size_t size, DungeonFile &dungeon, std::string &error)
+{
+    const char *pos = data;
+    const char *end = data + size;
+    long long header[2] = {0, 0};
+    for (long long &value : header)
+    {
+        while (pos < end && (*pos == ' ' || *pos == '\t'))
+            ++pos;
+        if (pos == end || *pos < '0' || *pos > '9')
+        {
+            error = "missing rows and columns on the first line";
+            return false;
+        }
+        for (; pos < end && *pos >= '0' && *pos <= '9' && value <= INT32_MAX; ++pos)
+            value = value * 10 + (*pos - '0');
+    }
+    if (header[0] <= 0 || header[1] <= 0 || header[0] * header[1] >= (1LL << 31) ||
+        header[0] > static_cast<long long>(size))
+    {
+        error = "invalid dungeon size " + std::to_string(header[0]) + "x" + std::to_string(header[1]);
+        return false;
+    }
+    const char *lineEnd = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+    pos = lineEnd ? lineEnd + 1 : end; // Skip the rest of the header line
+    dungeon.numRows = header[0];
+    dungeon.numCols = header[1];
+    dungeon.grid.assign(static_cast<std::size_t>(dungeon.numRows) * dungeon.numCols, ' ');
+    dungeon.actManCell = -1;
+    dungeon.monsters.clear();
+    for (int row = 0; row < dungeon.numRows; ++row)
+    {
+        if (pos >= end)
+        {
+            error = "expected " + std::to_string(dungeon.numRows) + " rows, found " + std::to_string(row);
+            return false;
+        }
+        lineEnd = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+        const char *next = lineEnd ? lineEnd + 1 : end;
+        std::size_t length = (lineEnd ? lineEnd : end) - pos;
+        if (length > 0 && pos[length - 1] == '\r')
+            --length;
+        if (length > static_cast<std::size_t>(dungeon.numCols))
+        {
+            error = "row " + std::to_string(row) + " has " + std::to_string(length) + " cells, expected " +
+                    std::to_string(dungeon.numCols);
+            return false;
+        }
+        int64_t rowStart = static_cast<int64_t>(row) * dungeon.numCols;
+        std::memcpy(dungeon.grid.data() + rowStart, pos, length);
+        for (std::size_t col = 0; col < length; ++col)
+        {
+            char cell = pos[col];
+            if (cell == 'A')
+                dungeon.actManCell = rowStart + col;
+            else if (cell == 'D' || cell == 'G')
+                dungeon.monsters.emplace_back(rowStart + col, cell);
+        }
+        pos = next;
+    }
+    for (; pos < end; ++pos)
+    {
+        if (*pos != '\n' && *pos != '\r' && *pos != ' ')
+        {
+            error = "more than " + std::to_string(dungeon.numRows) + " rows";
+            return false;
+        }
+    }
+    if (dungeon.actManCell < 0)
+    {
+        error = "no Act-Man ('A') in the dungeon";
+        return false;
+    }
+    return true;
+}
+
+// Function to map a dungeon file into memory and parse it; returns false and sets error on failure
+inline bool loadDungeonFile(const std::string &filename, DungeonFile &dungeon, std::string &error)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "Failed to open input file.";
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0)
+    {
+        close(fd);
+        error = "Input file is empty.";
+        return false;
+    }
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        error = "Failed to map input file.";
+        return false;
+    }
+    madvise(data, info.st_size, MADV_SEQUENTIAL);
+    bool parsed = parseDungeonFile(static_cast<const char *>(data), info.st_size, dungeon, error);
+    munmap(data, info.st_size);
+    if (!parsed)
+    {
+        error = "Invalid input file: " + error + ".";
+    }
+    return parsed;
+}
+
+#endif
@@ -7,8 +7,26 @@
 #include <algorithm> // For remove
 #include <random>    // For random_device, default_random_engine
 #include <chrono>    // For std::chrono::system_clock
+#include <array>     // For std::array
+#include <string>    // For std::string
+#include <map>       // For score histograms
+#include <thread>    // For std::thread
+#include <atomic>    // For std::atomic
+#include <cstdint>   // For uint64_t
+#include <climits>   // For INT_MAX
+#include <cerrno>    // For the range errors of strtoull
+#include <cctype>    // For isdigit
+#include <memory>    // For std::shared_ptr, std::unique_ptr
+#include <iterator>  // For std::istreambuf_iterator
+#include <sstream>   // For reading the score line of a plan
+#include <cmath>     // For log and sqrt in the MCTS selection rule
+#include "wall_runs.h"
+#include "dungeon_file.h"
+#include "bitboard.h"
 
 using namespace std;
+// Random number generator used for every random choice in a game
+typedef mt19937 Rng;
 // Enum to represent directions
 enum Direction
 {
@@ -21,96 +39,283 @@ enum Direction
     North_West = 1,
     South_West = 4
 };
+// Events of a game, as printed to the console and recorded in the binary trace
+enum TraceEvent : uint8_t
+{
+    EventActManMoved = 1, // Args: action, row, column
+    EventMoveIntoWall,    // Target cell is a wall
+    EventMoveOutOfBounds, // Target cell is outside the dungeon
+    EventWallInTheWay,    // The game loop refused a move towards a wall
+    EventCaught,          // Act-Man ran into a monster
+    EventPosition,        // Args: row, column (reported once per turn)
+    EventWin,             // All monsters eliminated
+    EventScoreZero,       // Score dropped to zero; the trace stores the final layout after it
+    EventCannotFire,      // The bullet could not be fired this turn
+    EventAlreadyFired,    // The bullet was spent earlier
+    EventMonsterMoved,    // Args: from row, from column, to row, to column (trace only)
+    EventBulletHit,       // Args: row, column of the monster hit (trace only)
+    EventTurnLimit,       // The game was called off after --max-turns turns
+    EventMonsterStomped,  // Args: row, column of the monster Act-Man stepped on (solver rules, --replay only)
+    EventCount
+};
+// Number of integer arguments stored after each event code
+const int kEventArgCount[EventCount] = {0, 3, 0, 0, 0, 0, 2, 0, 0, 0, 0, 4, 2, 0, 2};
+// Magic bytes at the start of a trace file, followed by a version byte
+// Version 2 added EventTurnLimit and version 3 EventMonsterStomped; older traces decode unchanged
+const char kTraceMagic[4] = {'A', 'M', 'T', 'R'};
+const uint8_t kTraceVersion = 3;
+// Class to write the binary event trace through a large buffer
+// Every event is a one-byte code followed by its arguments as zigzag varints
+class TraceWriter
+{
+public:
+    explicit TraceWriter(const string &filename) : file(filename, ios::binary)
+    {
+        buffer.reserve(kBufferSize);
+        buffer.insert(buffer.end(), kTraceMagic, kTraceMagic + 4);
+        buffer.push_back(kTraceVersion);
+    }
+    ~TraceWriter()
+    {
+        flush();
+    }
+    bool isOpen() const
+    {
+        return file.is_open();
+    }
+    // Function to append one byte
+    void putByte(uint8_t value)
+    {
+        buffer.push_back(value);
+        if (buffer.size() >= kBufferSize)
+            flush();
+    }
+    // Function to append a signed integer in zigzag varint form
+    void putInt(int64_t value)
+    {
+        uint64_t zigzag = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        while (zigzag >= 0x80)
+        {
+            putByte(static_cast<uint8_t>(zigzag | 0x80));
+            zigzag >>= 7;
+        }
+        putByte(static_cast<uint8_t>(zigzag));
+    }
+    // Function to hand the buffered bytes to the file
+    void flush()
+    {
+        file.write(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+
+private:
+    static const size_t kBufferSize = 1 << 16;
+    ofstream file;
+    vector<char> buffer;
+};
 // Struct to represent the game state
 struct GameState
 {
     vector<string> dungeonLayout;            // Vector to store dungeon layout
     pair<int, int> actManPos;                // Act-Man's current position
     vector<pair<int, int>> monsterPositions; // Monster positions
-    vector<pair<int, int>> wallPositions;    // Wall positions
-    vector<pair<int, int>> emptyCells;       // Empty cell positions
+    vector<char> monsterTypes;               // Monster types ('D' or 'G'), parallel to monsterPositions
+    vector<int> monsterAt;                   // Occupancy grid: row-major cell -> index into monsterPositions, -1 if empty
+    shared_ptr<const WallRuns> wallRuns;     // Bullet reach tables, shared by every copy of the game
+    SmallBoard board;                        // Static floor as a bitboard, for dungeons small enough to have one
+    shared_ptr<const vector<uint64_t>> kingSteps; // Per cell, board.words words: the floor cells a monster may step to
     int score;                               // Player's score
     bool bulletFired;                        // Flag to check if bullet is already fired
     vector<int> validActions;                // Vector to store valid actions
+    bool verbose;                            // Flag to print per-turn messages to the console
+    TraceWriter *trace;                      // Binary event trace, or nullptr when not tracing
+    bool cellOrder;                          // Monsters move in cell order, as the solver's greedy model has them, not shuffled
 };
+// Struct to hold how Act-Man is controlled and how long a game may last
+struct PlayOptions
+{
+    bool mcts = false;      // Pick moves by Monte Carlo Tree Search instead of at random
+    long long rollouts = 2000; // MCTS rollouts per move, shared between the threads
+    double moveMillis = 0;  // MCTS time budget per move in milliseconds, 0 for none
+    int threads = 1;        // MCTS threads, each growing its own tree
+    int horizon = 20;       // Random turns a rollout plays past the tree before it is scored
+    int maxTurns = 0;       // Turns after which a game is called off, 0 for no limit
+};
+// Function to print the console text of an event; shared by live games and the trace decoder
+void printEvent(ostream &out, TraceEvent event, const int64_t *args)
+{
+    switch (event)
+    {
+    case EventActManMoved:
+        out << "Act-Man moved to: (" << args[1] << ", " << args[2] << ")\n";
+        break;
+    case EventMoveIntoWall:
+        out << "Cannot move: Target cell is a wall.\n";
+        break;
+    case EventMoveOutOfBounds:
+        out << "Cannot move: Target cell is outside the bounds of the dungeon.\n";
+        break;
+    case EventWallInTheWay:
+        out << "Act-Man cannot move in the chosen direction because of a wall.\n";
+        break;
+    case EventCaught:
+        out << "Game Over! Act-Man was caught by a monster.\n";
+        break;
+    case EventPosition:
+        out << "Act-Man moved to: (" << args[0] << ", " << args[1] << ")\n";
+        break;
+    case EventWin:
+        out << "Congratulations! All monsters have been eliminated. Act-Man wins!\n";
+        break;
+    case EventScoreZero:
+        out << "Game Over! Act-Man's score dropped to zero.\n";
+        break;
+    case EventCannotFire:
+        out << "Act-Man cannot fire the bullet this time.\n";
+        break;
+    case EventAlreadyFired:
+        out << "Act-Man has already fired a bullet. Cannot fire again.\n";
+        break;
+    case EventTurnLimit:
+        out << "Game Over! The turn limit was reached.\n";
+        break;
+    case EventMonsterStomped:
+        out << "Act-Man eliminated the monster at: (" << args[0] << ", " << args[1] << ")\n";
+        break;
+    default:
+        break; // Monster moves and bullet hits have no console text
+    }
+}
+// Function to report an event: print it unless quiet, and append it to the trace if one is open
+void logEvent(GameState &gameState, TraceEvent event, int a = 0, int b = 0, int c = 0, int d = 0)
+{
+    if (!gameState.verbose && !gameState.trace)
+        return;
+    const int64_t args[4] = {a, b, c, d};
+    if (gameState.verbose)
+    {
+        printEvent(cout, event, args);
+        if (event == EventScoreZero)
+        {
+            // Print the updated dungeon configuration
+            for (const auto &row : gameState.dungeonLayout)
+                cout << row << '\n';
+        }
+    }
+    if (gameState.trace)
+    {
+        gameState.trace->putByte(event);
+        for (int i = 0; i < kEventArgCount[event]; ++i)
+            gameState.trace->putInt(args[i]);
+        if (event == EventScoreZero)
+        {
+            gameState.trace->putInt(gameState.dungeonLayout.size());
+            gameState.trace->putInt(gameState.dungeonLayout[0].size());
+            for (const auto &row : gameState.dungeonLayout)
+                for (char cell : row)
+                    gameState.trace->putByte(cell);
+        }
+    }
+}
 // Function to randomly select a direction for Act-Man
-Direction getRandomDirection()
+Direction getRandomDirection(Rng &rng)
 {
     // Generate a random number between 1 and 8 to represent the eight directions
-    int randomNum = rand() % 8 + 1;
+    int randomNum = rng() % 8 + 1;
     return static_cast<Direction>(randomNum);
 }
 // Function to read input file
 GameState readInputFile(const string &filename)
 {
-    ifstream inputFile(filename);
-    if (!inputFile.is_open())
+    DungeonFile file;
+    string error;
+    if (!loadDungeonFile(filename, file, error))
     {
-        cerr << "Error: Failed to open input file." << endl;
+        cerr << "Error: " << error << endl;
         exit(EXIT_FAILURE);
     }
     GameState gameState;
-    string line;
-    int numRows, numCols;
-    int row = 0;
-    // Read number of rows and columns
-    inputFile >> numRows >> numCols;
-    getline(inputFile, line); // Consume newline character
-    while (getline(inputFile, line))
-    {
-        // Process each line of the input file
-        if (!line.empty())
-        {
-            // Read dungeon layout
-            gameState.dungeonLayout.push_back(line);
-            for (int i = 0; i < line.size(); ++i)
-            {
-                if (line[i] == '#')
-                {
-                    // Found a wall
-                    gameState.wallPositions.push_back(make_pair(row, i));
-                }
-                else if (line[i] == ' ')
-                {
-                    // Found an empty cell
-                    gameState.emptyCells.push_back(make_pair(row, i));
-                }
-                else if (line[i] == 'A')
-                {
-                    // Found Act-Man's starting position
-                    gameState.actManPos = make_pair(row, i);
-                }
-                else if (line[i] == 'D' || line[i] == 'G')
-                {
-                    // Found a monster
-                    gameState.monsterPositions.push_back(make_pair(row, i));
-                }
-            }
-            row++;
-        }
+    int numRows = file.numRows;
+    int numCols = file.numCols;
+    // Read dungeon layout
+    gameState.dungeonLayout.resize(numRows);
+    for (int row = 0; row < numRows; ++row)
+    {
+        gameState.dungeonLayout[row].assign(file.grid.begin() + row * numCols, file.grid.begin() + (row + 1) * numCols);
+    }
+    // Act-Man's starting position and the monsters were found while the file was parsed
+    gameState.actManPos = make_pair(file.actManCell / numCols, file.actManCell % numCols);
+    for (const auto &monster : file.monsters)
+    {
+        gameState.monsterPositions.push_back(make_pair(monster.first / numCols, monster.first % numCols));
+        gameState.monsterTypes.push_back(monster.second);
     }
-    inputFile.close();
+    // Index the monsters by cell
+    gameState.monsterAt.assign(numRows * numCols, -1);
+    for (size_t i = 0; i < gameState.monsterPositions.size(); ++i)
+    {
+        gameState.monsterAt[gameState.monsterPositions[i].first * numCols + gameState.monsterPositions[i].second] = i;
+    }
+    // Precompute how far a bullet travels from each cell
+    gameState.wallRuns = make_shared<const WallRuns>(buildWallRuns(numRows, numCols, [&](int r, int c)
+                                                                   { return file.grid[r * numCols + c] == '#'; }));
+    gameState.board = buildSmallBoard(numRows, numCols, [&](int r, int c)
+                                      { return file.grid[r * numCols + c] == '#'; });
+    vector<uint64_t> kingSteps(static_cast<size_t>(gameState.board.words) * numRows * numCols);
+    kingNeighboursOnBoard(gameState.board, kingSteps.data());
+    gameState.kingSteps = make_shared<const vector<uint64_t>>(move(kingSteps));
     gameState.score = 50;          // Initialize score
     gameState.bulletFired = false; // Initialize bullet fired flag
+    gameState.verbose = true;      // Print the game as it is played
+    gameState.trace = nullptr;     // No binary trace unless one is requested
+    gameState.cellOrder = false;   // Shuffle the monsters' order every turn
     return gameState;
 }
+// Function to find the monster standing on a cell; returns its index in monsterPositions or -1
+int monsterAtCell(const GameState &gameState, int row, int col)
+{
+    return gameState.monsterAt[row * gameState.dungeonLayout[0].size() + col];
+}
+// Function to check if a cell blocks Act-Man; cells off the edge of the dungeon count as walls
+bool isWallAt(const GameState &gameState, int row, int col)
+{
+    return row < 0 || row >= static_cast<int>(gameState.dungeonLayout.size()) || col < 0 ||
+           col >= static_cast<int>(gameState.dungeonLayout[0].size()) || gameState.dungeonLayout[row][col] == '#';
+}
+// Function to remove a monster, keeping the occupancy grid in sync
+void removeMonster(GameState &gameState, int index)
+{
+    int numCols = gameState.dungeonLayout[0].size();
+    pair<int, int> pos = gameState.monsterPositions[index];
+    gameState.monsterAt[pos.first * numCols + pos.second] = -1;
+    // Move the last monster into the freed slot
+    int last = gameState.monsterPositions.size() - 1;
+    if (index != last)
+    {
+        gameState.monsterPositions[index] = gameState.monsterPositions[last];
+        gameState.monsterTypes[index] = gameState.monsterTypes[last];
+        gameState.monsterAt[gameState.monsterPositions[index].first * numCols + gameState.monsterPositions[index].second] = index;
+    }
+    gameState.monsterPositions.pop_back();
+    gameState.monsterTypes.pop_back();
+}
 // Function to move Act-Man
 void moveActMan(GameState &gameState, int dx, int dy, int action)
 {
     int newRow = gameState.actManPos.first + dx;
     int newCol = gameState.actManPos.second + dy;
     // Check if the target cell is within the bounds of the dungeon
-    if (newRow >= 0 && newRow < gameState.dungeonLayout.size() &&
-        newCol >= 0 && newCol < gameState.dungeonLayout[0].size())
+    if (newRow >= 0 && newRow < static_cast<int>(gameState.dungeonLayout.size()) &&
+        newCol >= 0 && newCol < static_cast<int>(gameState.dungeonLayout[0].size()))
     {
         // Check if the target cell is not a wall
         if (gameState.dungeonLayout[newRow][newCol] != '#')
         {
             // Check if the target cell contains a monster
-            if (gameState.dungeonLayout[newRow][newCol] == 'D' || gameState.dungeonLayout[newRow][newCol] == 'G')
+            if (monsterAtCell(gameState, newRow, newCol) >= 0)
             {
                 // Game ends because Act-Man encounters a monster
-                cout << "Game Over! Act-Man was caught by a monster." << endl;
+                logEvent(gameState, EventCaught);
                 // Update Act-Man's position to 'X' in the dungeon layout
                 gameState.dungeonLayout[gameState.actManPos.first][gameState.actManPos.second] = 'X';
                 gameState.actManPos = make_pair(-1, -1); // Update Act-Man's position to outside the dungeon
@@ -120,7 +325,7 @@ void moveActMan(GameState &gameState, int dx, int dy, int action)
             gameState.dungeonLayout[gameState.actManPos.first][gameState.actManPos.second] = ' '; // Erase previous position
             gameState.actManPos = make_pair(newRow, newCol);
             gameState.dungeonLayout[newRow][newCol] = 'A'; // Update new position
-            cout << "Act-Man moved to: (" << newRow << ", " << newCol << ")" << endl;
+            logEvent(gameState, EventActManMoved, action, newRow, newCol);
             gameState.score--; // Decrease score for moving
             // Record the valid action
             gameState.validActions.push_back(action);
@@ -128,71 +333,142 @@ void moveActMan(GameState &gameState, int dx, int dy, int action)
         else
         {
             // If the target cell is a wall, Act-Man cannot move
-            cout << "Cannot move: Target cell is a wall." << endl;
+            logEvent(gameState, EventMoveIntoWall);
             // Record the invalid action
             gameState.validActions.push_back(-1);
         }
     }
     else
     {
-        cout << "Cannot move: Target cell is outside the bounds of the dungeon." << endl;
+        logEvent(gameState, EventMoveOutOfBounds);
         // Record the invalid action
         gameState.validActions.push_back(-1);
     }
 }
 // Function to randomly select one of the four cardinal directions for firing the bullet
-pair<int, int> getRandomFiringDirection()
-{
-    // Seed the random number generator with current time
-    static unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    static default_random_engine eng(seed);
-    // Define cardinal directions array outside the function
-    static const array<pair<int, int>, 4> cardinalDirections = {
-        make_pair(-1, 0), // North
-        make_pair(1, 0),  // South
-        make_pair(0, 1),  // East
-        make_pair(0, -1)  // West
-    };
-    // Randomly select a cardinal direction
-    int index = rand() % cardinalDirections.size();
-    return cardinalDirections[index];
+// Returns an index into the wall-run tables (North, South, East, West)
+int getRandomFiringDirection(Rng &rng)
+{
+    return rng() % 4;
+}
+// Function to take out a monster hit by the bullet, marking its cell and lowering the score
+void hitMonster(GameState &gameState, int index)
+{
+    pair<int, int> pos = gameState.monsterPositions[index];
+    gameState.score -= 20; // Decrease score for hitting a monster
+    gameState.dungeonLayout[pos.first][pos.second] = '@';
+    logEvent(gameState, EventBulletHit, pos.first, pos.second);
+    removeMonster(gameState, index);
+}
+// Function to hit every monster within reach of Act-Man in a direction, on the dungeon's bitboard
+// The monsters on the ray are one mask. They are taken out in the order fireMagicBullet's cell-by-cell
+// branches use, so the monster list (and with it every later shuffle) comes out the same.
+template <int Words>
+void boardFireAlongRay(GameState &gameState, int direction, int reach)
+{
+    typedef Bitboard<Words> Board;
+    const BoardMasks<Words> masks(gameState.board);
+    int numCols = gameState.dungeonLayout[0].size();
+    Board monsters = {};
+    for (const pair<int, int> &pos : gameState.monsterPositions)
+    {
+        monsters.set(pos.first * numCols + pos.second);
+    }
+    int actManCell = gameState.actManPos.first * numCols + gameState.actManPos.second;
+    Board hits = masks.ray(actManCell, direction, reach) & monsters;
+    if (static_cast<int>(gameState.monsterPositions.size()) < reach)
+    {
+        // Monsters by falling index, as each removal moves the last monster into the freed slot
+        for (int i = gameState.monsterPositions.size() - 1; i >= 0; --i)
+        {
+            if (hits.test(gameState.monsterPositions[i].first * numCols + gameState.monsterPositions[i].second))
+                hitMonster(gameState, i);
+        }
+        return;
+    }
+    // Cells outward from Act-Man: highest first going north or west
+    bool outwardDown = direction == 0 || direction == 3;
+    for (int cell = outwardDown ? hits.highest() : hits.lowest(); cell >= 0;
+         cell = outwardDown ? hits.highest() : hits.lowest())
+    {
+        hits.reset(cell);
+        hitMonster(gameState, gameState.monsterAt[cell]);
+    }
+}
+// Function to fire along the ray on the dungeon's bitboard; returns false if it has none
+bool fireAlongRayOnBoard(GameState &gameState, int direction, int reach)
+{
+    switch (gameState.board.words)
+    {
+    case 1:
+        boardFireAlongRay<1>(gameState, direction, reach);
+        return true;
+    case 2:
+        boardFireAlongRay<2>(gameState, direction, reach);
+        return true;
+    case 3:
+        boardFireAlongRay<3>(gameState, direction, reach);
+        return true;
+    case 4:
+        boardFireAlongRay<4>(gameState, direction, reach);
+        return true;
+    default:
+        return false;
+    }
 }
 // Function for Act-Man to fire a magic bullet in one of the four cardinal directions
-void fireMagicBullet(GameState &gameState)
+void fireMagicBullet(GameState &gameState, Rng &rng)
 {
     // Randomly decide whether Act-Man can fire the bullet or not
-    if (rand() % 10 < 7)
+    if (rng() % 10 < 7)
     {
-        cout << "Act-Man cannot fire the bullet this time." << endl;
+        logEvent(gameState, EventCannotFire);
         return;
     }
     // Check if bullet is already fired
     if (gameState.bulletFired)
     {
-        cout << "Act-Man has already fired a bullet. Cannot fire again." << endl;
+        logEvent(gameState, EventAlreadyFired);
         return;
     }
     // Randomly select one of the four cardinal directions for firing the bullet
-    pair<int, int> direction = getRandomFiringDirection();
-    // Initialize target position
-    pair<int, int> targetPos = gameState.actManPos;
-    // Move target position in the chosen direction until hitting a wall or reaching the edge of the dungeon
-    while (targetPos.first >= 0 && targetPos.first < gameState.dungeonLayout.size() &&
-           targetPos.second >= 0 && targetPos.second < gameState.dungeonLayout[0].size() &&
-           gameState.dungeonLayout[targetPos.first][targetPos.second] != '#')
-    {
-        // Move to the next cell in the chosen direction
-        targetPos.first += direction.first;
-        targetPos.second += direction.second;
-        // Check if any monster is present at the target position
-        for (const auto &monsterPos : gameState.monsterPositions)
-        {
-            if (monsterPos == targetPos)
+    int direction = getRandomFiringDirection(rng);
+    int row = gameState.actManPos.first;
+    int col = gameState.actManPos.second;
+    int numCols = gameState.dungeonLayout[0].size();
+    // The bullet crosses every free cell up to the next wall or the edge of the dungeon
+    int reach = gameState.wallRuns->run(row, col, direction);
+    int dr = kRayRowStep[direction];
+    int dc = kRayColStep[direction];
+    if (fireAlongRayOnBoard(gameState, direction, reach))
+    {
+        // Small dungeon: the bitboard picked out the monsters on the ray
+    }
+    else if (static_cast<int>(gameState.monsterPositions.size()) < reach)
+    {
+        // Fewer monsters than cells on the ray: test each monster against the ray
+        for (int i = gameState.monsterPositions.size() - 1; i >= 0; --i)
+        {
+            int mr = gameState.monsterPositions[i].first - row;
+            int mc = gameState.monsterPositions[i].second - col;
+            int steps = dr ? (mc == 0 ? mr * dr : 0) : (mr == 0 ? mc * dc : 0);
+            if (steps > 0 && steps <= reach)
             {
                 // Monster hit by the bullet, remove it from the monster positions and update the dungeon layout
-                gameState.score -= 20; // Decrease score for hitting a monster
-                gameState.dungeonLayout[targetPos.first][targetPos.second] = '@';
-                gameState.monsterPositions.erase(remove(gameState.monsterPositions.begin(), gameState.monsterPositions.end(), monsterPos), gameState.monsterPositions.end());
+                hitMonster(gameState, i); // Moves the last monster into slot i, which was already tested
+            }
+        }
+    }
+    else
+    {
+        // Fewer cells than monsters: look each cell up in the occupancy grid
+        for (int step = 1; step <= reach; ++step)
+        {
+            int hit = gameState.monsterAt[(row + step * dr) * numCols + col + step * dc];
+            if (hit >= 0)
+            {
+                // Monster hit by the bullet, remove it from the monster positions and update the dungeon layout
+                hitMonster(gameState, hit);
             }
         }
     }
@@ -200,18 +476,149 @@ void fireMagicBullet(GameState &gameState)
     gameState.bulletFired = true;
 }
 
+// Function to flood the dungeon from Act-Man's cell, giving every cell its wall-aware distance to him
+// Distances count the same eight-way steps monsters take; cells cut off from Act-Man get INT_MAX
+void computeDistanceField(const GameState &gameState, vector<int> &distance, vector<int> &frontier)
+{
+    int numRows = gameState.dungeonLayout.size();
+    int numCols = gameState.dungeonLayout[0].size();
+    int start = gameState.actManPos.first * numCols + gameState.actManPos.second;
+    distance.resize(numRows * numCols);
+    if (kingDistancesOnBoard(gameState.board, start, distance.data(), INT_MAX))
+        return; // Small dungeon: the bitboard floods whole frontiers at once
+    distance.assign(numRows * numCols, INT_MAX);
+    frontier.clear();
+    distance[start] = 0;
+    frontier.push_back(start);
+    for (size_t k = 0; k < frontier.size(); ++k)
+    {
+        int row = frontier[k] / numCols;
+        int col = frontier[k] % numCols;
+        for (int i = -1; i <= 1; ++i)
+        {
+            for (int j = -1; j <= 1; ++j)
+            {
+                int newRow = row + i;
+                int newCol = col + j;
+                if (newRow >= 0 && newRow < numRows && newCol >= 0 && newCol < numCols &&
+                    gameState.dungeonLayout[newRow][newCol] != '#' && distance[newRow * numCols + newCol] == INT_MAX)
+                {
+                    distance[newRow * numCols + newCol] = distance[frontier[k]] + 1;
+                    frontier.push_back(newRow * numCols + newCol);
+                }
+            }
+        }
+    }
+}
+
+// Function to move a monster to a free cell, keeping the layout, the occupancy grid and the trace in sync
+void placeMonster(GameState &gameState, int index, int row, int col)
+{
+    int numCols = gameState.dungeonLayout[0].size();
+    pair<int, int> &monsterPos = gameState.monsterPositions[index];
+    logEvent(gameState, EventMonsterMoved, monsterPos.first, monsterPos.second, row, col);
+    // Erase the monster's previous position in the dungeon layout
+    gameState.dungeonLayout[monsterPos.first][monsterPos.second] = ' ';
+    gameState.monsterAt[monsterPos.first * numCols + monsterPos.second] = -1;
+    // Move the monster to this cell
+    monsterPos.first = row;
+    monsterPos.second = col;
+    gameState.monsterAt[row * numCols + col] = index;
+    // Update the dungeon layout based on monster type, leaving Act-Man visible if the monster reached him
+    if (gameState.dungeonLayout[row][col] != 'A')
+    {
+        gameState.dungeonLayout[row][col] = gameState.monsterTypes[index];
+    }
+}
+// Function to move the monsters in the given order on the dungeon's bitboard, as moveMonsters does cell by cell
+// A monster's free neighbours are one mask, its cell's king steps less the taken cells, read in increasing
+// cell order: the scan order that breaks ties on the grid.
+template <int Words>
+void boardMoveMonsters(GameState &gameState, const vector<int> &order, const vector<int> &distanceField)
+{
+    typedef Bitboard<Words> Board;
+    const uint64_t *kingSteps = gameState.kingSteps->data();
+    int numCols = gameState.dungeonLayout[0].size();
+    Board taken = {};
+    for (const pair<int, int> &pos : gameState.monsterPositions)
+    {
+        taken.set(pos.first * numCols + pos.second);
+    }
+    for (int index : order)
+    {
+        int cell = gameState.monsterPositions[index].first * numCols + gameState.monsterPositions[index].second;
+        int bestCell = -1;
+        pair<int, int> bestDistance(INT_MAX, INT_MAX);
+        Board free = Board::load(kingSteps + cell * Words) & ~taken;
+        free.forEach([&](int next)
+                     {
+                         if (distanceField[next] > bestDistance.first)
+                             return; // Farther along the floor: no need for the straight-line tie-break
+                         int dx = gameState.actManPos.first - next / numCols;
+                         int dy = gameState.actManPos.second - next % numCols;
+                         pair<int, int> distance(distanceField[next], dx * dx + dy * dy);
+                         if (distance < bestDistance)
+                         {
+                             bestDistance = distance;
+                             bestCell = next;
+                         } });
+        if (bestCell >= 0)
+        {
+            taken.reset(cell);
+            taken.set(bestCell);
+            placeMonster(gameState, index, bestCell / numCols, bestCell % numCols);
+        }
+    }
+}
+// Function to move the monsters in the given order on the dungeon's bitboard; returns false if it has none
+bool moveMonstersOnBoard(GameState &gameState, const vector<int> &order, const vector<int> &distanceField)
+{
+    switch (gameState.board.words)
+    {
+    case 1:
+        boardMoveMonsters<1>(gameState, order, distanceField);
+        return true;
+    case 2:
+        boardMoveMonsters<2>(gameState, order, distanceField);
+        return true;
+    case 3:
+        boardMoveMonsters<3>(gameState, order, distanceField);
+        return true;
+    case 4:
+        boardMoveMonsters<4>(gameState, order, distanceField);
+        return true;
+    default:
+        return false;
+    }
+}
 // Function to move monsters based on their type (demons or ogres)
-void moveMonsters(GameState &gameState)
+void moveMonsters(GameState &gameState, Rng &rng)
 {
-    // Seed the random number generator with current time
-    static unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    static default_random_engine eng(seed);
-    // Randomize movement order to avoid bias
-    shuffle(gameState.monsterPositions.begin(), gameState.monsterPositions.end(), eng);
-    for (auto &monsterPos : gameState.monsterPositions)
+    // One flood fill from Act-Man per turn, shared by every monster
+    static thread_local vector<int> distanceField, frontier, order;
+    computeDistanceField(gameState, distanceField, frontier);
+    int numCols = gameState.dungeonLayout[0].size();
+    // Randomize movement order to avoid bias (the monster arrays stay put, so the occupancy grid stays valid)
+    // or, for --monster-order=cells and replays, move them in scan order of their cells like the solver
+    order.resize(gameState.monsterPositions.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    if (gameState.cellOrder)
+        sort(order.begin(), order.end(), [&](int a, int b)
+             { return gameState.monsterPositions[a] < gameState.monsterPositions[b]; });
+    else
+        shuffle(order.begin(), order.end(), rng);
+    if (moveMonstersOnBoard(gameState, order, distanceField))
+        return; // Small dungeon: each monster's free neighbours come off the bitboard at once
+    for (int index : order)
     {
-        // Calculate distances to Act-Man for all adjacent cells
-        vector<pair<int, pair<int, int>>> distances; // Pair of distance and cell coordinates
+        pair<int, int> &monsterPos = gameState.monsterPositions[index];
+        // Pick the free adjacent cell closest to Act-Man along the floor; straight-line distance and
+        // then scan order (row, column) break ties
+        int bestRow = -1, bestCol = -1;
+        pair<int, int> bestDistance(INT_MAX, INT_MAX);
         for (int i = -1; i <= 1; ++i)
         {
             for (int j = -1; j <= 1; ++j)
@@ -221,44 +628,26 @@ void moveMonsters(GameState &gameState)
                 int newRow = monsterPos.first + i;
                 int newCol = monsterPos.second + j;
                 // Check if the target cell is within the bounds of the dungeon and not a wall
-                if (newRow >= 0 && newRow < gameState.dungeonLayout.size() &&
-                    newCol >= 0 && newCol < gameState.dungeonLayout[0].size() &&
+                if (newRow >= 0 && newRow < static_cast<int>(gameState.dungeonLayout.size()) &&
+                    newCol >= 0 && newCol < numCols &&
                     gameState.dungeonLayout[newRow][newCol] != '#')
                 {
-                    // Calculate Euclidean distance to Act-Man
                     int dx = gameState.actManPos.first - newRow;
                     int dy = gameState.actManPos.second - newCol;
-                    int distance = dx * dx + dy * dy; // Squared Euclidean distance for efficiency
-                    distances.push_back(make_pair(distance, make_pair(newRow, newCol)));
+                    pair<int, int> distance(distanceField[newRow * numCols + newCol], dx * dx + dy * dy);
+                    // Check if the cell is closer and not occupied by another monster
+                    if (distance < bestDistance && gameState.monsterAt[newRow * numCols + newCol] < 0)
+                    {
+                        bestDistance = distance;
+                        bestRow = newRow;
+                        bestCol = newCol;
+                    }
                 }
             }
         }
-        // Sort distances in ascending order
-        sort(distances.begin(), distances.end());
-        // Move the monster to the cell with the smallest distance to Act-Man that is not a wall
-        for (const auto &dist : distances)
+        if (bestRow >= 0)
         {
-            int newRow = dist.second.first;
-            int newCol = dist.second.second;
-            // Check if the cell is not occupied by another monster
-            if (find(gameState.monsterPositions.begin(), gameState.monsterPositions.end(), make_pair(newRow, newCol)) == gameState.monsterPositions.end())
-            {
-                // Erase the monster's previous position in the dungeon layout
-                gameState.dungeonLayout[monsterPos.first][monsterPos.second] = ' ';
-                // Move the monster to this cell
-                monsterPos.first = newRow;
-                monsterPos.second = newCol;
-                // Update the dungeon layout based on monster type
-                if (gameState.dungeonLayout[newRow][newCol] == 'D')
-                {
-                    gameState.dungeonLayout[newRow][newCol] = 'D'; // Monster (demon)
-                }
-                else if (gameState.dungeonLayout[newRow][newCol] == 'G')
-                {
-                    gameState.dungeonLayout[newRow][newCol] = 'G'; // Monster (ogre)
-                }
-                break;
-            }
+            placeMonster(gameState, index, bestRow, bestCol);
         }
     }
 }
@@ -289,101 +678,825 @@ void writeOutputFile(const string &filename, const GameState &gameState)
     outputFile << endl;
     outputFile.close();
 }
-// Main function
-int main(int argc, char *argv[])
+// Function to convert a direction to its change in coordinates
+void directionStep(Direction direction, int &dx, int &dy)
 {
-    // Check if the correct number of command-line arguments is provided
-    if (argc != 3)
+    dx = 0;
+    dy = 0;
+    switch (direction)
     {
-        cerr << "Usage: " << argv[0] << " <input_file> <output_file>" << endl;
-        return EXIT_FAILURE;
+    case North:
+        dx = -1;
+        break;
+    case South:
+        dx = 1;
+        break;
+    case East:
+        dy = 1;
+        break;
+    case West:
+        dy = -1;
+        break;
+    case North_East:
+        dx = -1;
+        dy = 1;
+        break;
+    case South_East:
+        dx = 1;
+        dy = 1;
+        break;
+    case North_West:
+        dx = -1;
+        dy = -1;
+        break;
+    case South_West:
+        dx = 1;
+        dy = -1;
+        break;
     }
-    // Read input file
-    GameState gameState = readInputFile(argv[1]);
-    // Seed the random number generator with current time
-    srand(time(nullptr));
+}
+// Outcome of one turn
+enum TurnResult
+{
+    TurnContinue,
+    TurnCaught,   // Act-Man ran into a monster
+    TurnWon,      // All monsters eliminated
+    TurnScoreZero // Score dropped to zero
+};
+// Function to play one turn: Act-Man moves in a direction, the monsters answer, and the bullet may fire
+// Shared by real games and MCTS rollouts, so both follow exactly the same rules
+TurnResult playTurn(GameState &gameState, Direction direction, Rng &rng)
+{
+    int dx, dy;
+    directionStep(direction, dx, dy);
+    // Move Act-Man only if the target cell is valid (not a wall or off the dungeon)
+    if (!isWallAt(gameState, gameState.actManPos.first + dx, gameState.actManPos.second + dy))
+    {
+        // Move Act-Man
+        moveActMan(gameState, dx, dy, direction);
+    }
+    else
+    {
+        // If the target cell is a wall, Act-Man does not move
+        logEvent(gameState, EventWallInTheWay);
+    }
+    // Check if Act-Man's position is outside the dungeon (game over)
+    if (gameState.actManPos.first == -1 && gameState.actManPos.second == -1)
+    {
+        return TurnCaught;
+    }
+    // Print Act-Man's new position
+    logEvent(gameState, EventPosition, gameState.actManPos.first, gameState.actManPos.second);
+    // Move monsters
+    moveMonsters(gameState, rng);
+    // Check if all monsters are eliminated (player wins)
+    if (gameState.monsterPositions.empty())
+    {
+        logEvent(gameState, EventWin);
+        return TurnWon;
+    }
+    // Check if Act-Man's score drops to zero (player loses)
+    if (gameState.score <= 0)
+    {
+        logEvent(gameState, EventScoreZero); // Also prints or records the final layout
+        return TurnScoreZero;
+    }
+    // Fire magic bullet with a certain probability
+    if (rng() % 10 < 7)
+    {
+        fireMagicBullet(gameState, rng);
+    }
+    return TurnContinue;
+}
+// Every direction, in the order MCTS tries them
+const Direction kAllDirections[8] = {North_West, North, North_East, West, East, South_West, South, South_East};
+// Nodes one MCTS tree may hold; when it is full, rollouts keep running but the tree stops growing
+const int kMaxTreeNodes = 1 << 18;
+// Turn limit of MCTS games unless --max-turns says otherwise
+const int kDefaultMctsTurns = 1000;
+// Exploration constant of the UCB1 rule (rewards lie in [0, 1])
+const double kExploration = 0.7;
+// Struct to hold one node of an MCTS tree
+// The tree is open loop: a node stands for a sequence of Act-Man's moves, and the monsters and the
+// bullet are sampled afresh by every rollout that passes through it.
+struct MctsNode
+{
+    int firstChild;      // Index of the first child, -1 until the node is expanded
+    uint8_t numChildren; // Children are stored next to each other
+    uint8_t direction;   // Direction taken from the parent
+    int visits;
+    double reward; // Sum of the rewards of the rollouts through the node
+};
+// Function to get the time of the steady clock in nanoseconds
+uint64_t nowNanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+// Function to copy the parts of a game a rollout needs into a scratch state
+// Assigning into the same scratch state every time reuses its buffers, so rollouts do not allocate
+void copyForRollout(const GameState &from, GameState &to)
+{
+    to.dungeonLayout = from.dungeonLayout;
+    to.actManPos = from.actManPos;
+    to.monsterPositions = from.monsterPositions;
+    to.monsterTypes = from.monsterTypes;
+    to.monsterAt = from.monsterAt;
+    if (to.wallRuns != from.wallRuns)
+        to.wallRuns = from.wallRuns; // Skip the reference count traffic once it is shared
+    to.board = from.board;
+    if (to.kingSteps != from.kingSteps)
+        to.kingSteps = from.kingSteps;
+    to.score = from.score;
+    to.bulletFired = from.bulletFired;
+    to.validActions.clear(); // Rollouts do not keep the action history
+    to.verbose = false;
+    to.trace = nullptr;
+    to.cellOrder = from.cellOrder;
+}
+// Function to list the moves worth trying from a state: every direction that is not a wall, plus one
+// wall direction standing for "stay put" (bumping into any wall does the same thing)
+int candidateDirections(const GameState &gameState, Direction *directions)
+{
+    int count = 0;
+    bool wait = false;
+    for (Direction direction : kAllDirections)
+    {
+        int dx, dy;
+        directionStep(direction, dx, dy);
+        bool wall = isWallAt(gameState, gameState.actManPos.first + dx, gameState.actManPos.second + dy);
+        if (!wall || !wait)
+            directions[count++] = direction;
+        wait = wait || wall;
+    }
+    return count;
+}
+// Function to score the end of a rollout in [0, 1]: a win is 1 and a loss 0; a game still running
+// after the horizon earns credit for surviving, for the monsters eliminated and for the score kept
+double rolloutReward(const GameState &root, const GameState &end, TurnResult result)
+{
+    if (result == TurnWon)
+        return 1.0;
+    if (result != TurnContinue)
+        return 0.0;
+    double eliminated = root.monsterPositions.size() - end.monsterPositions.size();
+    return 0.2 + 0.5 * eliminated / root.monsterPositions.size() + 0.2 * min(1.0, end.score / 50.0);
+}
+// Function to run MCTS rollouts from a game on one thread and add up the visits and rewards of the moves at the root
+// Stops after the given number of rollouts or at the deadline (0 for none), whichever comes first
+void mctsSearch(const GameState &root, const PlayOptions &options, long long rollouts, uint64_t deadline, uint64_t seed,
+                array<long long, 10> &visits, array<double, 10> &rewards)
+{
+    Rng rng(seed);
+    vector<MctsNode> tree;
+    tree.reserve(kMaxTreeNodes);
+    vector<int> path;
+    path.reserve(64);
+    GameState scratch;
+    tree.push_back({-1, 0, 0, 0, 0.0});
+    for (long long rollout = 0; rollout < rollouts; ++rollout)
+    {
+        if (deadline && rollout % 16 == 0 && nowNanos() >= deadline)
+            break;
+        copyForRollout(root, scratch);
+        path.assign(1, 0);
+        TurnResult result = TurnContinue;
+        int node = 0;
+        // Selection: follow the UCB1 rule down the expanded part of the tree
+        while (result == TurnContinue && tree[node].firstChild >= 0)
+        {
+            const MctsNode &parent = tree[node];
+            double logVisits = log(max(1, parent.visits));
+            int best = -1;
+            double bestScore = -1.0;
+            for (int i = parent.firstChild; i < parent.firstChild + parent.numChildren; ++i)
+            {
+                if (tree[i].visits == 0)
+                {
+                    best = i; // Try every move once first
+                    break;
+                }
+                double score = tree[i].reward / tree[i].visits + kExploration * sqrt(logVisits / tree[i].visits);
+                if (score > bestScore)
+                {
+                    bestScore = score;
+                    best = i;
+                }
+            }
+            node = best;
+            path.push_back(node);
+            result = playTurn(scratch, static_cast<Direction>(tree[node].direction), rng);
+        }
+        // Expansion: give the leaf its children once it has been visited, then step into the first
+        if (result == TurnContinue && (tree[node].visits > 0 || node == 0) && tree.size() + 8 <= kMaxTreeNodes)
+        {
+            Direction directions[8];
+            int count = candidateDirections(scratch, directions);
+            tree[node].firstChild = tree.size();
+            tree[node].numChildren = count;
+            for (int i = 0; i < count; ++i)
+                tree.push_back({-1, 0, static_cast<uint8_t>(directions[i]), 0, 0.0});
+            node = tree[node].firstChild;
+            path.push_back(node);
+            result = playTurn(scratch, static_cast<Direction>(tree[node].direction), rng);
+        }
+        // Simulation: random moves, as the original Act-Man plays, up to the horizon
+        for (int turn = 0; result == TurnContinue && turn < options.horizon; ++turn)
+            result = playTurn(scratch, getRandomDirection(rng), rng);
+        // Backpropagation
+        double reward = rolloutReward(root, scratch, result);
+        for (int index : path)
+        {
+            tree[index].visits++;
+            tree[index].reward += reward;
+        }
+    }
+    const MctsNode &top = tree[0];
+    for (int i = top.firstChild; top.firstChild >= 0 && i < top.firstChild + top.numChildren; ++i)
+    {
+        visits[tree[i].direction] += tree[i].visits;
+        rewards[tree[i].direction] += tree[i].reward;
+    }
+}
+// Function to pick Act-Man's next move with Monte Carlo Tree Search
+// Each thread grows its own tree from a seed drawn from the game's generator (root parallelism), and the
+// move visited most over all trees is played. With a rollout budget and no time limit the choice is
+// reproducible from the game seed.
+Direction chooseMctsDirection(const GameState &gameState, const PlayOptions &options, Rng &rng)
+{
+    uint64_t seed = (static_cast<uint64_t>(rng()) << 32) | rng();
+    uint64_t deadline = options.moveMillis > 0 ? nowNanos() + static_cast<uint64_t>(options.moveMillis * 1e6) : 0;
+    vector<array<long long, 10>> visits(options.threads);
+    vector<array<double, 10>> rewards(options.threads);
+    vector<thread> workers;
+    for (int t = 0; t < options.threads; ++t)
+    {
+        visits[t].fill(0);
+        rewards[t].fill(0.0);
+        long long share = options.rollouts / options.threads + (t < options.rollouts % options.threads);
+        auto work = [&, t, share]()
+        { mctsSearch(gameState, options, share, deadline, seed + t * 0x9E3779B97F4A7C15ULL, visits[t], rewards[t]); };
+        if (t + 1 < options.threads)
+            workers.emplace_back(work);
+        else
+            work(); // The calling thread grows the last tree
+    }
+    for (auto &worker : workers)
+        worker.join();
+    Direction best = kAllDirections[0];
+    long long bestVisits = -1;
+    for (Direction direction : kAllDirections)
+    {
+        long long total = 0;
+        for (int t = 0; t < options.threads; ++t)
+            total += visits[t][direction];
+        if (total > bestVisits)
+        {
+            bestVisits = total;
+            best = direction;
+        }
+    }
+    return best;
+}
+// Function to play one game until Act-Man wins or loses; returns the number of turns played
+int playGame(GameState &gameState, Rng &rng, const PlayOptions &options)
+{
+    int turns = 0;
     // Main game loop
     while (true)
     {
-        // Randomly select a direction for Act-Man to move
-        Direction direction = getRandomDirection();
-        int dx = 0, dy = 0;
-        // Convert direction to corresponding change in coordinates
-        switch (direction)
+        if (options.maxTurns > 0 && turns == options.maxTurns)
         {
-        case North:
-            dx = -1;
-            break;
-        case South:
-            dx = 1;
-            break;
-        case East:
-            dy = 1;
-            break;
-        case West:
-            dy = -1;
-            break;
-        case North_East:
-            dx = -1;
-            dy = 1;
-            break;
-        case South_East:
-            dx = 1;
-            dy = 1;
-            break;
-        case North_West:
-            dx = -1;
-            dy = -1;
-            break;
-        case South_West:
-            dx = 1;
-            dy = -1;
+            logEvent(gameState, EventTurnLimit);
             break;
         }
-        // Move Act-Man only if the target cell is valid (not a wall)
-        if (gameState.dungeonLayout[gameState.actManPos.first + dx][gameState.actManPos.second + dy] != '#')
+        turns++;
+        // Pick a direction for Act-Man: at random, or by tree search
+        Direction direction = options.mcts ? chooseMctsDirection(gameState, options, rng) : getRandomDirection(rng);
+        if (playTurn(gameState, direction, rng) != TurnContinue)
+        {
+            break; // Exit the game loop
+        }
+    }
+    return turns;
+}
+// Actions of a solver (1.cpp) plan, indexed by the solver's action codes: moves and bullets North, South, East,
+// West, then the wait it writes when Act-Man fires the spent bullet
+const int kPlanWait = 8;
+const char *const kPlanActions[kPlanWait + 1] = {"Move North", "Move South", "Move East", "Move West",
+                                                 "Fire Bullet North", "Fire Bullet South", "Fire Bullet East",
+                                                 "Fire Bullet West", "Wait"};
+// Numeric-keypad direction of each of the solver's moves
+const Direction kPlanDirections[4] = {North, South, East, West};
+// Struct to hold a plan written by the solver: its actions, then the score and final layout it claims
+struct SolverPlan
+{
+    vector<string> actions;
+    int score = 0;
+    vector<string> layout;
+};
+// Function to read a plan in the solver's output format; returns false if it has no score line
+bool readPlanFile(const string &filename, SolverPlan &plan)
+{
+    ifstream planFile(filename);
+    string line;
+    while (getline(planFile, line) && line.compare(0, 7, "Score: ") != 0)
+    {
+        plan.actions.push_back(line);
+    }
+    istringstream score(line.compare(0, 7, "Score: ") == 0 ? line.substr(7) : "");
+    if (!(score >> plan.score))
+        return false;
+    while (getline(planFile, line))
+    {
+        plan.layout.push_back(line);
+    }
+    return true;
+}
+// Function to play one ply of a solver plan under the solver's rules rather than the simulator's: Act-Man
+// moves orthogonally and eliminates the monster he steps on, the bullet stops at the first monster on its
+// ray, and each of those costs a point and earns 5 per monster; walking into a wall or firing the spent
+// bullet (a plan's "Wait") changes nothing. The monsters then answer in cell order, and one that reaches
+// Act-Man catches him. Sets eliminated when Act-Man's action killed a monster.
+TurnResult replayTurn(GameState &gameState, int code, bool &eliminated, Rng &rng)
+{
+    int numCols = gameState.dungeonLayout[0].size();
+    int row = gameState.actManPos.first;
+    int col = gameState.actManPos.second;
+    eliminated = false;
+    if (code < 4)
+    {
+        int newRow = row + kRayRowStep[code];
+        int newCol = col + kRayColStep[code];
+        if (gameState.dungeonLayout[newRow][newCol] == '#')
         {
-            // Move Act-Man
-            moveActMan(gameState, dx, dy, direction);
+            logEvent(gameState, EventMoveIntoWall);
+            gameState.validActions.push_back(-1);
         }
         else
         {
-            // If the target cell is a wall, Act-Man does not move
-            cout << "Act-Man cannot move in the chosen direction because of a wall." << endl;
+            int hit = monsterAtCell(gameState, newRow, newCol);
+            if (hit >= 0)
+            {
+                logEvent(gameState, EventMonsterStomped, newRow, newCol);
+                removeMonster(gameState, hit);
+                gameState.score += 5;
+                eliminated = true;
+            }
+            gameState.dungeonLayout[row][col] = ' ';
+            gameState.dungeonLayout[newRow][newCol] = 'A';
+            gameState.actManPos = make_pair(newRow, newCol);
+            logEvent(gameState, EventActManMoved, kPlanDirections[code], newRow, newCol);
+            gameState.score--;
+            gameState.validActions.push_back(kPlanDirections[code]);
         }
-        // Check if Act-Man's position is outside the dungeon (game over)
-        if (gameState.actManPos.first == -1 && gameState.actManPos.second == -1)
+    }
+    else if (gameState.bulletFired)
+    {
+        logEvent(gameState, EventAlreadyFired); // A bullet code or a wait
+    }
+    else
+    {
+        int direction = code - 4;
+        int reach = gameState.wallRuns->run(row, col, direction);
+        for (int step = 1; step <= reach; ++step)
         {
-            break; // Exit the game loop
+            int hitRow = row + step * kRayRowStep[direction];
+            int hitCol = col + step * kRayColStep[direction];
+            int hit = gameState.monsterAt[hitRow * numCols + hitCol];
+            if (hit >= 0)
+            {
+                gameState.dungeonLayout[hitRow][hitCol] = '@';
+                logEvent(gameState, EventBulletHit, hitRow, hitCol);
+                removeMonster(gameState, hit);
+                gameState.score += 5;
+                eliminated = true;
+                break; // The bullet stops at the first monster
+            }
         }
-        // Print Act-Man's new position
-        cout << "Act-Man moved to: (" << gameState.actManPos.first << ", " << gameState.actManPos.second << ")" << endl;
-        // Move monsters
-        moveMonsters(gameState);
-        // Check if all monsters are eliminated (player wins)
-        if (gameState.monsterPositions.empty())
+        gameState.bulletFired = true;
+        gameState.score--;
+    }
+    if (gameState.monsterPositions.empty())
+    {
+        logEvent(gameState, EventWin);
+        return TurnWon;
+    }
+    logEvent(gameState, EventPosition, gameState.actManPos.first, gameState.actManPos.second);
+    moveMonsters(gameState, rng);
+    if (monsterAtCell(gameState, gameState.actManPos.first, gameState.actManPos.second) >= 0)
+    {
+        logEvent(gameState, EventCaught);
+        gameState.dungeonLayout[gameState.actManPos.first][gameState.actManPos.second] = 'X';
+        return TurnCaught;
+    }
+    if (gameState.score <= 0)
+    {
+        logEvent(gameState, EventScoreZero);
+        return TurnScoreZero;
+    }
+    return TurnContinue;
+}
+// Function to play back a plan found by the solver with --monsters=greedy and check that it does what the
+// plan says: every "and Eliminate Monster" happens, the game does not end early, and the score and the
+// positions of Act-Man and the monsters match the plan's final layout. Returns false on the first mismatch.
+bool replayPlan(GameState &gameState, const SolverPlan &plan)
+{
+    Rng rng(0); // Monsters move in cell order, so nothing is random
+    gameState.cellOrder = true;
+    TurnResult result = TurnContinue;
+    for (size_t ply = 0; ply < plan.actions.size(); ++ply)
+    {
+        string action = plan.actions[ply];
+        const string kill = " and Eliminate Monster";
+        bool expectKill = action.size() > kill.size() && action.compare(action.size() - kill.size(), kill.size(), kill) == 0;
+        if (expectKill)
+            action.resize(action.size() - kill.size());
+        int code = find(kPlanActions, kPlanActions + kPlanWait + 1, action) - kPlanActions;
+        if (code > kPlanWait)
         {
-            cout << "Congratulations! All monsters have been eliminated. Act-Man wins!" << endl;
-            break; // Exit the game loop
+            cerr << "Error: Plan line " << ply + 1 << " is not an action: " << plan.actions[ply] << endl;
+            return false;
         }
-        // Check if Act-Man's score drops to zero (player loses)
-        if (gameState.score <= 0)
+        if (result != TurnContinue)
         {
-            cout << "Game Over! Act-Man's score dropped to zero." << endl;
-            // Print the updated dungeon configuration
-            for (const auto &row : gameState.dungeonLayout)
+            cerr << "Replay diverges from the plan: the game ended before ply " << ply + 1 << "." << endl;
+            return false;
+        }
+        bool eliminated = false;
+        if (code != kPlanWait || gameState.bulletFired) // Waiting takes the spent bullet
+            result = replayTurn(gameState, code, eliminated, rng);
+        if (eliminated != expectKill || (code == kPlanWait && !gameState.bulletFired))
+        {
+            cerr << "Replay diverges from the plan at ply " << ply + 1 << " (" << plan.actions[ply] << ")." << endl;
+            return false;
+        }
+    }
+    // Compare the pieces on the final layout; the bullet's '@' mark is drawn differently and is left out
+    int numRows = gameState.dungeonLayout.size();
+    int numCols = gameState.dungeonLayout[0].size();
+    bool layoutMatches = static_cast<int>(plan.layout.size()) == numRows;
+    for (int row = 0; layoutMatches && row < numRows; ++row)
+    {
+        layoutMatches = static_cast<int>(plan.layout[row].size()) == numCols;
+        for (int col = 0; layoutMatches && col < numCols; ++col)
+        {
+            char expected = plan.layout[row][col];
+            char actual = gameState.dungeonLayout[row][col];
+            if (make_pair(row, col) == gameState.actManPos)
+                actual = result == TurnCaught ? 'X' : 'A';
+            else if (monsterAtCell(gameState, row, col) < 0)
+                actual = ' ';
+            if (expected != 'A' && expected != 'X' && expected != 'D' && expected != 'G')
+                expected = ' ';
+            layoutMatches = expected == actual;
+        }
+    }
+    if (!layoutMatches || gameState.score != plan.score)
+    {
+        cerr << "Replay diverges from the plan: it ends with score " << gameState.score << " where the plan has "
+             << plan.score << (layoutMatches ? "." : ", and a different final layout.") << endl;
+        return false;
+    }
+    cout << "Replay matches the plan: " << plan.actions.size() << " plies, score " << gameState.score << "." << endl;
+    return true;
+}
+// Function to derive the seed of one game from the batch seed, so results do not depend on threading
+uint64_t gameSeed(uint64_t batchSeed, uint64_t game)
+{
+    uint64_t x = batchSeed + (game + 1) * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+// Struct to accumulate the results of a batch of games
+struct BatchStats
+{
+    long long games = 0;
+    long long wins = 0;
+    long long caught = 0;           // Losses where a monster caught Act-Man
+    long long scoreLosses = 0;      // Losses where the score dropped to zero
+    long long turnLimits = 0;       // Games called off at --max-turns
+    long long totalTurns = 0;
+    long long totalScore = 0;
+    map<int, long long> scores;     // Final score -> number of games
+    map<int, long long> turnCounts; // Power-of-two bucket start -> number of games
+};
+// Function to add one finished game to the batch statistics
+void recordGame(BatchStats &stats, const GameState &gameState, int turns)
+{
+    stats.games++;
+    if (gameState.actManPos == make_pair(-1, -1))
+        stats.caught++;
+    else if (gameState.monsterPositions.empty())
+        stats.wins++;
+    else if (gameState.score <= 0)
+        stats.scoreLosses++;
+    else
+        stats.turnLimits++;
+    stats.totalTurns += turns;
+    stats.totalScore += gameState.score;
+    stats.scores[gameState.score]++;
+    int bucket = 1;
+    while (bucket * 2 <= turns)
+        bucket *= 2;
+    stats.turnCounts[bucket]++;
+}
+// Function to merge one thread's statistics into the batch totals
+void mergeStats(BatchStats &total, const BatchStats &part)
+{
+    total.games += part.games;
+    total.wins += part.wins;
+    total.caught += part.caught;
+    total.scoreLosses += part.scoreLosses;
+    total.turnLimits += part.turnLimits;
+    total.totalTurns += part.totalTurns;
+    total.totalScore += part.totalScore;
+    for (const auto &entry : part.scores)
+        total.scores[entry.first] += entry.second;
+    for (const auto &entry : part.turnCounts)
+        total.turnCounts[entry.first] += entry.second;
+}
+// Function to play a batch of games on several threads, each game seeded from the batch seed
+// MCTS runs on the game's own thread here: the threads already play separate games
+BatchStats runBatch(const GameState &initialState, long long numGames, int numThreads, uint64_t batchSeed,
+                    const PlayOptions &options)
+{
+    atomic<long long> nextGame(0);
+    vector<BatchStats> threadStats(numThreads);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        workers.emplace_back([&, t]()
+                             {
+                                 Rng rng; // One generator per thread, reseeded for every game
+                                 for (long long game = nextGame++; game < numGames; game = nextGame++)
+                                 {
+                                     rng.seed(gameSeed(batchSeed, game));
+                                     GameState gameState = initialState;
+                                     int turns = playGame(gameState, rng, options);
+                                     recordGame(threadStats[t], gameState, turns);
+                                 } });
+    }
+    BatchStats total;
+    for (int t = 0; t < numThreads; ++t)
+    {
+        workers[t].join();
+        mergeStats(total, threadStats[t]);
+    }
+    return total;
+}
+// Function to write the batch statistics
+void writeBatchFile(const string &filename, const BatchStats &stats)
+{
+    ofstream outputFile(filename);
+    if (!outputFile.is_open())
+    {
+        cerr << "Error: Failed to open output file." << endl;
+        exit(EXIT_FAILURE);
+    }
+    double games = stats.games ? stats.games : 1;
+    outputFile << "Games: " << stats.games << "\n";
+    outputFile << "Wins: " << stats.wins << " (" << 100.0 * stats.wins / games << "%)\n";
+    outputFile << "Losses: " << stats.caught + stats.scoreLosses << " (caught " << stats.caught
+               << ", score dropped to zero " << stats.scoreLosses << ")\n";
+    if (stats.turnLimits > 0)
+        outputFile << "Turn limit reached: " << stats.turnLimits << "\n";
+    outputFile << "Mean score: " << stats.totalScore / games << "\n";
+    outputFile << "Mean turns: " << stats.totalTurns / games << "\n";
+    outputFile << "Score histogram:\n";
+    for (const auto &entry : stats.scores)
+        outputFile << "  " << entry.first << " " << entry.second << "\n";
+    outputFile << "Turn histogram:\n";
+    for (const auto &entry : stats.turnCounts)
+        outputFile << "  " << entry.first << "-" << entry.first * 2 - 1 << " " << entry.second << "\n";
+    outputFile.close();
+}
+// Function to read a zigzag varint from a trace buffer; returns false at the end of the data
+bool readTraceInt(const vector<char> &data, size_t &pos, int64_t &value)
+{
+    uint64_t zigzag = 0;
+    for (int shift = 0; pos < data.size() && shift < 64; shift += 7)
+    {
+        uint8_t byte = data[pos++];
+        zigzag |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+        {
+            value = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+            return true;
+        }
+    }
+    return false;
+}
+// Function to turn a binary trace back into the console text of the game it recorded
+bool decodeTrace(const string &filename, ostream &out)
+{
+    ifstream traceFile(filename, ios::binary);
+    if (!traceFile.is_open())
+    {
+        cerr << "Error: Failed to open trace file." << endl;
+        return false;
+    }
+    vector<char> data((istreambuf_iterator<char>(traceFile)), istreambuf_iterator<char>());
+    if (data.size() < 5 || !equal(kTraceMagic, kTraceMagic + 4, data.begin()) || data[4] < 1 || data[4] > kTraceVersion)
+    {
+        cerr << "Error: Not a trace file." << endl;
+        return false;
+    }
+    for (size_t pos = 5; pos < data.size();)
+    {
+        uint8_t event = data[pos++];
+        int64_t args[4] = {0, 0, 0, 0};
+        bool valid = event > 0 && event < EventCount;
+        for (int i = 0; valid && i < kEventArgCount[event]; ++i)
+            valid = readTraceInt(data, pos, args[i]);
+        if (valid && event == EventScoreZero)
+        {
+            int64_t numRows = 0, numCols = 0;
+            valid = readTraceInt(data, pos, numRows) && readTraceInt(data, pos, numCols) && numRows >= 0 && numCols >= 0;
+            // The layout must fit in what is left; divided rather than multiplied so a corrupt size cannot overflow
+            int64_t remaining = static_cast<int64_t>(data.size() - pos);
+            valid = valid && (numCols == 0 ? numRows <= remaining : numRows <= remaining / numCols);
+            if (valid)
             {
-                cout << row << endl;
+                printEvent(out, EventScoreZero, args);
+                for (int64_t row = 0; row < numRows; ++row, pos += numCols)
+                    out.write(data.data() + pos, numCols) << '\n';
+                continue;
             }
-            break; // Exit the game loop
         }
-        // Fire magic bullet with a certain probability
-        if (rand() % 10 < 7)
+        if (!valid)
         {
-            fireMagicBullet(gameState);
+            cerr << "Error: Trace file is truncated or corrupt." << endl;
+            return false;
         }
+        printEvent(out, static_cast<TraceEvent>(event), args);
+    }
+    return true;
+}
+// Most threads --threads may ask for
+const int kMaxThreads = 1024;
+// Function to parse the value of a whole-number flag; prints an error and returns false unless it is
+// a plain decimal number from minValue to maxValue
+bool parseFlagNumber(const string &text, const char *what, unsigned long long minValue, unsigned long long maxValue,
+                     unsigned long long &value)
+{
+    char *end;
+    errno = 0;
+    value = strtoull(text.c_str(), &end, 10);
+    if (text.empty() || !isdigit(static_cast<unsigned char>(text[0])) || *end != '\0' || errno == ERANGE ||
+        value < minValue || value > maxValue)
+    {
+        cerr << "Error: Invalid " << what << " " << text << "; expected " << minValue << " to " << maxValue << "." << endl;
+        return false;
     }
+    return true;
+}
+// Main function
+int main(int argc, char *argv[])
+{
+    vector<string> files;
+    long long numGames = 0; // 0 plays a single game and writes its output file
+    int numThreads = 1;
+    uint64_t seed = time(nullptr);
+    bool quiet = false;
+    string traceFilename;
+    string agent = "random";
+    string monsterOrder = "shuffled";
+    string planFilename;
+    PlayOptions options;
+    unsigned long long number;
+    for (int i = 1; i < argc; ++i)
+    {
+        string arg = argv[i];
+        if (arg.compare(0, 15, "--decode-trace=") == 0)
+            return decodeTrace(arg.substr(15), cout) ? EXIT_SUCCESS : EXIT_FAILURE;
+        else if (arg == "--quiet")
+            quiet = true;
+        else if (arg.compare(0, 8, "--trace=") == 0)
+            traceFilename = arg.substr(8);
+        else if (arg.compare(0, 8, "--games=") == 0)
+        {
+            if (!parseFlagNumber(arg.substr(8), "number of games", 0, LLONG_MAX, number))
+                return EXIT_FAILURE;
+            numGames = number;
+        }
+        else if (arg.compare(0, 10, "--threads=") == 0)
+        {
+            if (!parseFlagNumber(arg.substr(10), "thread count", 1, kMaxThreads, number))
+                return EXIT_FAILURE;
+            numThreads = number;
+        }
+        else if (arg.compare(0, 7, "--seed=") == 0)
+        {
+            if (!parseFlagNumber(arg.substr(7), "seed", 0, ULLONG_MAX, number))
+                return EXIT_FAILURE;
+            seed = number;
+        }
+        else if (arg.compare(0, 8, "--agent=") == 0)
+            agent = arg.substr(8);
+        else if (arg.compare(0, 11, "--rollouts=") == 0)
+        {
+            if (!parseFlagNumber(arg.substr(11), "rollout count", 1, LLONG_MAX, number))
+                return EXIT_FAILURE;
+            options.rollouts = number;
+        }
+        else if (arg.compare(0, 12, "--move-time=") == 0)
+        {
+            char *end;
+            options.moveMillis = strtod(arg.c_str() + 12, &end);
+            if (end == arg.c_str() + 12 || *end != '\0' || !(options.moveMillis >= 0) || options.moveMillis > 1e12)
+            {
+                cerr << "Error: Invalid move time " << arg.substr(12) << "; expected milliseconds." << endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else if (arg.compare(0, 10, "--horizon=") == 0)
+        {
+            if (!parseFlagNumber(arg.substr(10), "rollout horizon", 0, INT_MAX, number))
+                return EXIT_FAILURE;
+            options.horizon = number;
+        }
+        else if (arg.compare(0, 12, "--max-turns=") == 0)
+        {
+            if (!parseFlagNumber(arg.substr(12), "turn limit", 0, INT_MAX, number))
+                return EXIT_FAILURE;
+            options.maxTurns = number;
+        }
+        else if (arg.compare(0, 16, "--monster-order=") == 0)
+            monsterOrder = arg.substr(16);
+        else if (arg.compare(0, 9, "--replay=") == 0)
+            planFilename = arg.substr(9);
+        else
+            files.push_back(arg);
+    }
+    // Check if the correct number of command-line arguments is provided
+    if (files.size() != 2 || (agent != "random" && agent != "mcts") || (monsterOrder != "shuffled" && monsterOrder != "cells"))
+    {
+        cerr << "Usage: " << argv[0] << " <input_file> <output_file> [--games=N] [--threads=T] [--seed=S] [--quiet] [--trace=file]"
+             << " [--agent=random|mcts [--rollouts=N] [--move-time=MS] [--horizon=N]] [--max-turns=N]"
+             << " [--monster-order=shuffled|cells]" << endl;
+        cerr << "       " << argv[0] << " <input_file> <output_file> --replay=<plan_file> [--quiet] [--trace=file]" << endl;
+        cerr << "       " << argv[0] << " --decode-trace=<trace_file>" << endl;
+        cerr << "--replay plays back a plan the solver found with --monsters=greedy, under the solver's rules, and"
+             << " checks that it ends as the plan says." << endl;
+        return EXIT_FAILURE;
+    }
+    options.mcts = agent == "mcts";
+    if (options.mcts && options.maxTurns == 0)
+    {
+        options.maxTurns = kDefaultMctsTurns; // A careful agent can stall forever by bumping into walls
+    }
+    // Read input file
+    GameState gameState = readInputFile(files[0]);
+    gameState.cellOrder = monsterOrder == "cells";
+    SolverPlan plan;
+    if (!planFilename.empty())
+    {
+        if (numGames > 0 || options.mcts)
+        {
+            cerr << "Error: --replay plays the plan's own moves and cannot be combined with --games or --agent." << endl;
+            return EXIT_FAILURE;
+        }
+        if (!readPlanFile(planFilename, plan))
+        {
+            cerr << "Error: Failed to read a plan with a score line from " << planFilename << "." << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (numGames > 0)
+    {
+        if (!traceFilename.empty())
+        {
+            cerr << "Error: --trace records a single game and cannot be combined with --games." << endl;
+            return EXIT_FAILURE;
+        }
+        // Batch mode: play quietly and write the aggregate statistics instead of one game
+        gameState.verbose = false;
+        writeBatchFile(files[1], runBatch(gameState, numGames, numThreads, seed, options));
+        return EXIT_SUCCESS;
+    }
+    // Seed the random number generator with current time unless a seed was given
+    Rng rng(seed);
+    gameState.verbose = !quiet;
+    unique_ptr<TraceWriter> trace;
+    if (!traceFilename.empty())
+    {
+        trace.reset(new TraceWriter(traceFilename));
+        if (!trace->isOpen())
+        {
+            cerr << "Error: Failed to open trace file." << endl;
+            return EXIT_FAILURE;
+        }
+        gameState.trace = trace.get();
+    }
+    options.threads = numThreads; // A single game spends the threads on MCTS rollouts
+    bool matches = true;
+    if (!planFilename.empty())
+        matches = replayPlan(gameState, plan);
+    else
+        playGame(gameState, rng, options);
+    trace.reset(); // Flush the trace before the output file is written
     // Write output file
-    writeOutputFile(argv[2], gameState);
-    return EXIT_SUCCESS;
+    writeOutputFile(files[1], gameState);
+    return matches ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,251 @@
+#ifndef SOLUTION_CACHE_H
+#define SOLUTION_CACHE_H
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Persistent cache of solver results, keyed by a canonical description of the problem (used by 1.cpp)
+// A cache directory holds two files:
+//   plans  append-only log of records {key, canonical length, payload length, canonical, payload}
+//   index  open-addressing table of {key, log offset + 1} slots behind a 32-byte header
+// A lookup probes the index and reads one record with pread, so a hit costs a handful of system calls
+// however long the log grows. The canonical text is stored in full and compared on every hit, so hash
+// collisions cannot return another problem's result. Writers append the record before publishing it
+// in the index, holding an exclusive flock on the index; readers hold a shared one. A crash can leave
+// an unreferenced record behind, never an index slot pointing at a torn one. Storing a problem again
+// points its slot at the newer record.
+class SolutionCache
+{
+public:
+    SolutionCache() = default;
+    SolutionCache(const SolutionCache &) = delete;
+    SolutionCache &operator=(const SolutionCache &) = delete;
+
+    ~SolutionCache()
+    {
+        if (indexFd >= 0)
+            close(indexFd);
+        if (logFd >= 0)
+            close(logFd);
+    }
+
+    // Function to open or create the cache in a directory; returns false and sets error on failure
+    bool open(const std::string &directory, std::string &error)
+    {
+        mkdir(directory.c_str(), 0777); // Fails harmlessly if it exists; the opens below catch the rest
+        logFd = ::open((directory + "/plans").c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+        indexFd = ::open((directory + "/index").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+        if (logFd < 0 || indexFd < 0)
+        {
+            error = "Failed to open solution cache in " + directory + ".";
+            return false;
+        }
+        std::lock_guard<std::mutex> guard(lock);
+        FileLock fileLock(indexFd, LOCK_EX);
+        Header header;
+        if (!readHeader(header))
+        {
+            struct stat info;
+            if (fstat(indexFd, &info) != 0 || info.st_size != 0)
+            {
+                error = "Solution cache index in " + directory + " is not a cache index.";
+                return false;
+            }
+            if (!writeTable(std::vector<Slot>(kInitialSlots), 0)) // A new cache
+            {
+                error = "Failed to initialize solution cache in " + directory + ".";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Function to find the payload stored for a canonical description; returns false on a miss
+    bool lookup(const std::string &canonical, std::string &payload)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        FileLock fileLock(indexFd, LOCK_SH);
+        Header header;
+        if (!readHeader(header))
+            return false;
+        uint64_t key = hashKey(canonical);
+        uint64_t mask = header.slotCount - 1;
+        for (uint64_t i = key & mask;; i = (i + 1) & mask)
+        {
+            Slot slot;
+            if (!readSlot(i, slot) || slot.offset == 0)
+                return false;
+            if (slot.key == key && readRecord(slot.offset - 1, key, canonical, &payload))
+                return true;
+        }
+    }
+
+    // Function to add a payload for a canonical description; returns false if the files could not be written
+    bool store(const std::string &canonical, const std::string &payload)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        FileLock fileLock(indexFd, LOCK_EX);
+        Header header;
+        if (!readHeader(header))
+            return false;
+        uint64_t key = hashKey(canonical);
+        off_t offset = lseek(logFd, 0, SEEK_END);
+        RecordHeader record = {key, static_cast<uint32_t>(canonical.size()), static_cast<uint32_t>(payload.size())};
+        std::string bytes(reinterpret_cast<const char *>(&record), sizeof(record));
+        bytes += canonical;
+        bytes += payload;
+        if (offset < 0 || !writeAll(logFd, bytes.data(), bytes.size(), -1))
+            return false;
+        uint64_t mask = header.slotCount - 1;
+        for (uint64_t i = key & mask;; i = (i + 1) & mask)
+        {
+            Slot slot;
+            if (!readSlot(i, slot))
+                return false;
+            if (slot.offset == 0 || (slot.key == key && readRecord(slot.offset - 1, key, canonical, nullptr)))
+            {
+                bool added = slot.offset == 0;
+                slot = {key, static_cast<uint64_t>(offset) + 1};
+                if (!writeAll(indexFd, &slot, sizeof(slot), sizeof(Header) + i * sizeof(Slot)))
+                    return false;
+                if (!added)
+                    return true;
+                header.used++;
+                break;
+            }
+        }
+        if (header.used * 2 <= header.slotCount)
+            return writeAll(indexFd, &header, sizeof(header), 0);
+        // Past half full: rehash into a table twice the size, rewritten in place under the exclusive lock
+        std::vector<Slot> slots(header.slotCount);
+        if (pread(indexFd, slots.data(), slots.size() * sizeof(Slot), sizeof(Header)) !=
+            static_cast<ssize_t>(slots.size() * sizeof(Slot)))
+            return false;
+        std::vector<Slot> grown(header.slotCount * 2);
+        for (const Slot &slot : slots)
+        {
+            if (slot.offset == 0)
+                continue;
+            uint64_t i = slot.key & (grown.size() - 1);
+            while (grown[i].offset != 0)
+                i = (i + 1) & (grown.size() - 1);
+            grown[i] = slot;
+        }
+        return writeTable(grown, header.used);
+    }
+
+private:
+    static const char *magic() { return "AMSC"; }
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint64_t kInitialSlots = 1 << 10;
+
+    struct Header
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t slotCount; // Power of two
+        uint64_t used;
+        uint64_t reserved;
+    };
+
+    struct Slot
+    {
+        uint64_t key;
+        uint64_t offset; // Log offset + 1 of the record; 0 marks an empty slot
+    };
+
+    struct RecordHeader
+    {
+        uint64_t key;
+        uint32_t canonicalLength;
+        uint32_t payloadLength;
+    };
+
+    // Holds an flock for as long as it lives
+    struct FileLock
+    {
+        int fd;
+        FileLock(int fd, int operation) : fd(fd) { flock(fd, operation); }
+        ~FileLock() { flock(fd, LOCK_UN); }
+    };
+
+    int indexFd = -1;
+    int logFd = -1;
+    std::mutex lock; // flock does not exclude threads sharing the descriptors, so batch workers take this too
+
+    // Function to hash a canonical description (FNV-1a, then a final avalanche)
+    static uint64_t hashKey(const std::string &canonical)
+    {
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        for (unsigned char c : canonical)
+            hash = (hash ^ c) * 0x100000001B3ULL;
+        hash = (hash ^ (hash >> 33)) * 0xFF51AFD7ED558CCDULL;
+        return hash ^ (hash >> 33);
+    }
+
+    // Function to write a whole buffer, at an offset or (offset < 0) at the end of an O_APPEND file
+    static bool writeAll(int fd, const void *data, size_t size, off_t offset)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            ssize_t written = offset < 0 ? write(fd, bytes, size) : pwrite(fd, bytes, size, offset);
+            if (written <= 0)
+                return false;
+            bytes += written;
+            size -= written;
+            offset = offset < 0 ? offset : offset + written;
+        }
+        return true;
+    }
+
+    // Function to read and check the index header
+    bool readHeader(Header &header) const
+    {
+        return pread(indexFd, &header, sizeof(header), 0) == sizeof(header) &&
+               std::memcmp(header.magic, magic(), 4) == 0 && header.version == kVersion && header.slotCount != 0 &&
+               (header.slotCount & (header.slotCount - 1)) == 0;
+    }
+
+    bool readSlot(uint64_t i, Slot &slot) const
+    {
+        return pread(indexFd, &slot, sizeof(slot), sizeof(Header) + i * sizeof(Slot)) == sizeof(slot);
+    }
+
+    // Function to check that the record at an offset holds a canonical description, and read its payload
+    bool readRecord(uint64_t offset, uint64_t key, const std::string &canonical, std::string *payload) const
+    {
+        RecordHeader record;
+        if (pread(logFd, &record, sizeof(record), offset) != sizeof(record) || record.key != key ||
+            record.canonicalLength != canonical.size())
+            return false;
+        std::string bytes(static_cast<size_t>(record.canonicalLength) + record.payloadLength, '\0');
+        if (pread(logFd, &bytes[0], bytes.size(), offset + sizeof(record)) != static_cast<ssize_t>(bytes.size()) ||
+            bytes.compare(0, canonical.size(), canonical) != 0)
+            return false;
+        if (payload)
+            payload->assign(bytes, canonical.size(), std::string::npos);
+        return true;
+    }
+
+    // Function to replace the whole index with a table of slots
+    bool writeTable(const std::vector<Slot> &slots, uint64_t used)
+    {
+        Header header = {};
+        std::memcpy(header.magic, magic(), 4);
+        header.version = kVersion;
+        header.slotCount = slots.size();
+        header.used = used;
+        return writeAll(indexFd, slots.data(), slots.size() * sizeof(Slot), sizeof(Header)) &&
+               writeAll(indexFd, &header, sizeof(header), 0);
+    }
+};
+
+#endif
@@ -0,0 +1,96 @@
+# Stand-in client for the solver's server mode (1.cpp --serve), for testing and load measurements
+#   python3 solver_client.py --socket PATH DUNGEON... [--repeat N] [--connections C] [--output-dir DIR]
+#   python3 solver_client.py --solver BINARY [--solver-args="--algo=astar"] DUNGEON... [--repeat N] [--output-dir DIR]
+# The first form talks to "BINARY --serve=PATH" over a Unix socket, the second starts "BINARY --serve" and
+# talks to it over its stdin and stdout. Every dungeon is sent --repeat times; responses are checked for
+# framing, optionally written out under the input's file name, and summed up on stderr.
+import argparse
+import os
+import shlex
+import socket
+import subprocess
+import sys
+import threading
+import time
+
+
+# Function to send one dungeon and read its response frame; returns (kind, fields, body)
+def solve(writer, reader, dungeon):
+    writer.write(b"SOLVE %d\n" % len(dungeon) + dungeon)
+    writer.flush()
+    header = reader.readline()
+    if not header.endswith(b"\n"):
+        raise RuntimeError("server closed the connection")
+    kind, size, *fields = header.decode().split()
+    body = reader.read(int(size))
+    if len(body) != int(size):
+        raise RuntimeError("server closed the connection mid-response")
+    return kind, fields, body
+
+
+# Function to send a list of (name, dungeon) requests over one connection, recording every outcome
+def run_requests(writer, reader, requests, outcomes, output_dir):
+    for name, dungeon in requests:
+        kind, fields, body = solve(writer, reader, dungeon)
+        outcomes.append(fields[0] if kind == "RESULT" else "error")
+        if kind == "ERROR":
+            print("%s: %s" % (name, body.decode(errors="replace")), file=sys.stderr)
+        elif output_dir:
+            with open(os.path.join(output_dir, os.path.basename(name)), "wb") as output:
+                output.write(body)
+    writer.write(b"QUIT\n")
+    writer.flush()
+
+
+# Function to spread the requests over connections to a Unix socket, one thread per connection
+def run_socket(path, requests, connections, outcomes, output_dir):
+    def work(share):
+        with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as client:
+            client.connect(path)
+            with client.makefile("rb") as reader, client.makefile("wb") as writer:
+                run_requests(writer, reader, share, outcomes, output_dir)
+
+    threads = [threading.Thread(target=work, args=(requests[i::connections],)) for i in range(connections)]
+    for thread in threads:
+        thread.start()
+    for thread in threads:
+        thread.join()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Send dungeons to the solver's server mode and time the answers.")
+    target = parser.add_mutually_exclusive_group(required=True)
+    target.add_argument("--socket", help="Unix socket of a running 'solver --serve=PATH'")
+    target.add_argument("--solver", help="solver binary to start as 'BINARY --serve' on a pipe")
+    parser.add_argument("--solver-args", default="", help="extra arguments for the started solver")
+    parser.add_argument("--repeat", type=int, default=1, help="times every dungeon is sent")
+    parser.add_argument("--connections", type=int, default=1, help="parallel connections (--socket only)")
+    parser.add_argument("--output-dir", help="write every answer here under its input's file name")
+    parser.add_argument("dungeons", nargs="+")
+    args = parser.parse_args()
+
+    requests = []
+    for name in args.dungeons:
+        with open(name, "rb") as dungeon:
+            requests.append((name, dungeon.read()))
+    requests *= args.repeat
+    if args.output_dir:
+        os.makedirs(args.output_dir, exist_ok=True)
+    outcomes = []
+    start = time.perf_counter()
+    if args.socket:
+        run_socket(args.socket, requests, max(1, args.connections), outcomes, args.output_dir)
+    else:
+        command = [args.solver, "--serve"] + shlex.split(args.solver_args)
+        with subprocess.Popen(command, stdin=subprocess.PIPE, stdout=subprocess.PIPE) as server:
+            run_requests(server.stdin, server.stdout, requests, outcomes, args.output_dir)
+            server.stdin.close()
+    seconds = time.perf_counter() - start
+    counts = {outcome: outcomes.count(outcome) for outcome in sorted(set(outcomes))}
+    print("%d requests in %.3fs (%.0f per second): %s" % (len(outcomes), seconds, len(outcomes) / seconds,
+          ", ".join("%d %s" % (count, outcome) for outcome, count in counts.items())), file=sys.stderr)
+    return 1 if "error" in counts or len(outcomes) != len(requests) else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
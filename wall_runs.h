@@ -0,0 +1,66 @@
+#ifndef WALL_RUNS_H
+#define WALL_RUNS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Precomputed ray lengths for magic bullets, shared by the simulator (hw1.cpp) and the solver (1.cpp)
+// For every cell and cardinal direction the table stores how many free cells lie between the cell
+// and the next wall, so a bullet's reach is one lookup instead of a walk along the ray.
+// Directions are indexed North, South, East, West; the edge of the dungeon counts as a wall.
+// Runs are stored in 32 bits, so no ray in a loadable dungeon can overflow its entry.
+struct WallRuns
+{
+    int numRows = 0;
+    int numCols = 0;
+    std::vector<std::array<uint32_t, 4>> runs; // Row-major, one entry per cell
+
+    // Function to get the number of cells a bullet fired from a cell crosses before hitting a wall
+    int run(int row, int col, int direction) const
+    {
+        return runs[static_cast<std::size_t>(row) * numCols + col][direction];
+    }
+};
+
+// Row and column steps of each ray direction, in table order
+const int kRayRowStep[4] = {-1, 1, 0, 0};
+const int kRayColStep[4] = {0, 0, 1, -1};
+
+// Function to build the ray tables of a dungeon; isWall(row, col) reports its static walls
+template <class IsWall>
+WallRuns buildWallRuns(int numRows, int numCols, IsWall isWall)
+{
+    WallRuns table;
+    table.numRows = numRows;
+    table.numCols = numCols;
+    table.runs.assign(static_cast<std::size_t>(numRows) * numCols, {0, 0, 0, 0});
+    // North and West runs extend the neighbour above or to the left, so sweep forwards
+    for (int row = 0; row < numRows; ++row)
+    {
+        for (int col = 0; col < numCols; ++col)
+        {
+            std::array<uint32_t, 4> &cell = table.runs[static_cast<std::size_t>(row) * numCols + col];
+            if (row > 0 && !isWall(row - 1, col))
+                cell[0] = table.runs[static_cast<std::size_t>(row - 1) * numCols + col][0] + 1;
+            if (col > 0 && !isWall(row, col - 1))
+                cell[3] = table.runs[static_cast<std::size_t>(row) * numCols + col - 1][3] + 1;
+        }
+    }
+    // South and East runs extend the neighbour below or to the right, so sweep backwards
+    for (int row = numRows - 1; row >= 0; --row)
+    {
+        for (int col = numCols - 1; col >= 0; --col)
+        {
+            std::array<uint32_t, 4> &cell = table.runs[static_cast<std::size_t>(row) * numCols + col];
+            if (row + 1 < numRows && !isWall(row + 1, col))
+                cell[1] = table.runs[static_cast<std::size_t>(row + 1) * numCols + col][1] + 1;
+            if (col + 1 < numCols && !isWall(row, col + 1))
+                cell[2] = table.runs[static_cast<std::size_t>(row) * numCols + col + 1][2] + 1;
+        }
+    }
+    return table;
+}
+
+#endif